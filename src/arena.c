@@ -0,0 +1,218 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Arena allocator.
+ *
+ * Memory is handed out from large blocks, one allocation after another.
+ * Each allocation is preceded by a header giving its size, so it can be
+ * resized. Nothing is freed until the whole arena is freed.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "arena.h"
+
+/** Alignment of every allocation. */
+#define ARENA__ALIGN (_Alignof(max_align_t))
+
+/** Size of the header before each allocation. */
+#define ARENA__HEADER ARENA__ALIGN
+
+/** A block of memory that allocations are made from. */
+struct arena__block {
+	struct arena__block *prev; /**< Previously used block, or NULL. */
+	size_t size;               /**< Number of bytes in data. */
+	size_t used;               /**< Number of bytes of data used. */
+	max_align_t data[];        /**< The memory allocations are made from. */
+};
+
+struct arena {
+	struct arena__block *block; /**< Block being allocated from. */
+	uint8_t *last;              /**< Last allocation in block, or NULL. */
+	size_t block_size;          /**< Size for new blocks. */
+};
+
+/**
+ * Round a size up to the allocation alignment.
+ */
+static inline size_t arena__round(size_t size)
+{
+	return (size + ARENA__ALIGN - 1) & ~(ARENA__ALIGN - 1);
+}
+
+/**
+ * Get the size stored in an allocation's header.
+ */
+static inline size_t *arena__size(uint8_t *ptr)
+{
+	return (size_t *)(void *)(ptr - ARENA__HEADER);
+}
+
+/**
+ * Start a new block, big enough for at least the given number of bytes.
+ */
+static bool arena__block_add(struct arena *arena, size_t size)
+{
+	struct arena__block *block;
+
+	if (size < arena->block_size) {
+		size = arena->block_size;
+	}
+
+	block = calloc(1, sizeof(*block) + size);
+	if (block == NULL) {
+		return false;
+	}
+
+	block->prev = arena->block;
+	block->size = size;
+	arena->block = block;
+	arena->last = NULL;
+	return true;
+}
+
+/**
+ * Get the number of unused bytes in the current block.
+ */
+static inline size_t arena__space(const struct arena *arena)
+{
+	if (arena->block == NULL) {
+		return 0;
+	}
+
+	return arena->block->size - arena->block->used;
+}
+
+/**
+ * Allocate memory from the current block, starting a new one if needed.
+ */
+static uint8_t *arena__take(struct arena *arena, size_t size)
+{
+	size_t need = ARENA__HEADER + arena__round(size);
+	uint8_t *ptr;
+
+	if (arena__space(arena) < need) {
+		if (!arena__block_add(arena, need)) {
+			return NULL;
+		}
+	}
+
+	ptr = (uint8_t *)arena->block->data + arena->block->used;
+	ptr += ARENA__HEADER;
+	*arena__size(ptr) = arena__round(size);
+
+	arena->block->used += need;
+	arena->last = ptr;
+	return ptr;
+}
+
+struct arena *arena_create(size_t size)
+{
+	struct arena *arena;
+
+	arena = calloc(1, sizeof(*arena));
+	if (arena == NULL) {
+		return NULL;
+	}
+
+	arena->block_size = arena__round(size);
+	if (!arena__block_add(arena, 0)) {
+		free(arena);
+		return NULL;
+	}
+
+	return arena;
+}
+
+bool arena_reserve(struct arena *arena, size_t count, size_t size)
+{
+	size_t need = size + count * (ARENA__HEADER + ARENA__ALIGN - 1);
+
+	if (arena__space(arena) >= need) {
+		return true;
+	}
+
+	return arena__block_add(arena, need);
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	uint8_t *ptr = arena__take(arena, size);
+
+	if (ptr != NULL) {
+		/* Memory handed back by the last allocation may be dirty. */
+		memset(ptr, 0, size);
+	}
+
+	return ptr;
+}
+
+void *arena_realloc(struct arena *arena, void *ptr, size_t size)
+{
+	uint8_t *old = ptr;
+	uint8_t *new;
+	size_t old_size;
+
+	if (old == NULL) {
+		return (size > 0) ? arena__take(arena, size) : NULL;
+	}
+
+	old_size = *arena__size(old);
+
+	if (old == arena->last) {
+		/* The last allocation can be resized in place. */
+		size_t start = (size_t)(old - (uint8_t *)arena->block->data);
+
+		if (size == 0) {
+			arena->block->used = start - ARENA__HEADER;
+			arena->last = NULL;
+			return NULL;
+		}
+
+		if (start + arena__round(size) <= arena->block->size) {
+			arena->block->used = start + arena__round(size);
+			*arena__size(old) = arena__round(size);
+			return old;
+		}
+
+	} else if (size == 0) {
+		return NULL;
+
+	} else if (size <= old_size) {
+		return old;
+	}
+
+	new = arena__take(arena, size);
+	if (new == NULL) {
+		return NULL;
+	}
+
+	memcpy(new, old, (old_size < size) ? old_size : size);
+	return new;
+}
+
+void arena_free(struct arena *arena)
+{
+	if (arena != NULL) {
+		struct arena__block *block = arena->block;
+
+		while (block != NULL) {
+			struct arena__block *prev = block->prev;
+
+			free(block);
+			block = prev;
+		}
+
+		free(arena);
+	}
+}
@@ -0,0 +1,66 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Arena allocator.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+struct arena;
+
+/**
+ * Create an arena.
+ *
+ * \param[in]  size  Size of the arena's first block of memory.
+ * \return a new arena, or NULL on error.
+ */
+struct arena *arena_create(size_t size);
+
+/**
+ * Make sure an arena can make some allocations without a new block.
+ *
+ * The allocations made after reserving sit together in memory.
+ *
+ * \param[in]  arena  The arena.
+ * \param[in]  count  Number of allocations to reserve for.
+ * \param[in]  size   Total number of bytes of the allocations.
+ * \return true on success, or false on error.
+ */
+bool arena_reserve(struct arena *arena, size_t count, size_t size);
+
+/**
+ * Allocate zeroed memory from an arena.
+ *
+ * \param[in]  arena  The arena to allocate from.
+ * \param[in]  size   Number of bytes to allocate.
+ * \return the memory, or NULL on error.
+ */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/**
+ * Resize memory allocated from an arena.
+ *
+ * Memory is only given back to the arena if it was the last allocated.
+ * Growing memory leaves the new part with unspecified contents.
+ *
+ * \param[in]  arena  The arena the memory came from.
+ * \param[in]  ptr    The memory to resize, or NULL to allocate.
+ * \param[in]  size   New size in bytes, or 0 to free.
+ * \return the resized memory, or NULL if freed or on error.
+ */
+void *arena_realloc(struct arena *arena, void *ptr, size_t size);
+
+/**
+ * Destroy an arena, freeing everything allocated from it.
+ *
+ * \param[in]  arena  The arena to destroy.
+ */
+void arena_free(struct arena *arena);
+
+#endif /* ARENA_H */
@@ -0,0 +1,477 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Solving many puzzle files in one run.
+ *
+ * Puzzles are solved in chunks on a worker thread pool, with each thread
+ * solving one puzzle at a time, with its own puzzle and output. The
+ * summary lines for a chunk are written in batch order once the chunk is
+ * done, so the summary doesn't depend on the number of threads.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <dirent.h>
+#include <time.h>
+
+#include "batch.h"
+#include "output.h"
+#include "puzzle.h"
+#include "options.h"
+#include "pool.h"
+
+/** Number of puzzles to solve per thread, between summary writes. */
+#define BATCH__JOBS_PER_THREAD 16
+
+/** A puzzle of the batch. */
+struct batch__item {
+	char *input;            /**< Path to the puzzle file. */
+	char *output;           /**< Path to write the GIF to, or NULL. */
+	struct options options; /**< Options for solving the puzzle. */
+
+	const char *status; /**< Outcome of solving the puzzle. */
+	double seconds;     /**< Time spent loading and solving the puzzle. */
+	size_t passes;      /**< Number of passes made by the line solvers. */
+	size_t cells;       /**< Number of cells solved. */
+	size_t cell_count;  /**< Number of cells in the puzzle. */
+	size_t solutions;   /**< Number of solutions found, when counting. */
+};
+
+/** A batch run. */
+struct batch {
+	const struct options *options; /**< The options. */
+
+	struct batch__item *item; /**< The puzzles of the batch. */
+	size_t item_count;        /**< Number of entries in item. */
+	size_t item_cap;          /**< Allocated entries in item. */
+
+	size_t first; /**< Index of the first item of the current chunk. */
+};
+
+/**
+ * Time since some fixed point, in seconds.
+ */
+static double batch__time(void)
+{
+	struct timespec ts;
+
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * Copy a string.
+ */
+static char *batch__strndup(const char *str, size_t len)
+{
+	char *copy = malloc(len + 1);
+
+	if (copy != NULL) {
+		memcpy(copy, str, len);
+		copy[len] = '\0';
+	}
+
+	return copy;
+}
+
+/**
+ * Add a puzzle file to the batch.
+ *
+ * \param[in]  b     The batch.
+ * \param[in]  path  Path to the puzzle file. Ownership passes to the batch.
+ * \return true on success, or false on error.
+ */
+static bool batch__add(struct batch *b, char *path)
+{
+	if (path == NULL) {
+		return false;
+	}
+
+	if (b->item_count == b->item_cap) {
+		size_t cap = (b->item_cap > 0) ? b->item_cap * 2 : 64;
+		struct batch__item *item = realloc(b->item,
+				cap * sizeof(*item));
+
+		if (item == NULL) {
+			free(path);
+			return false;
+		}
+		b->item = item;
+		b->item_cap = cap;
+	}
+
+	memset(&b->item[b->item_count], 0, sizeof(*b->item));
+	b->item[b->item_count++].input = path;
+	return true;
+}
+
+/**
+ * Order batch items by input path.
+ */
+static int batch__item_cmp(const void *a, const void *b)
+{
+	const struct batch__item *ia = a;
+	const struct batch__item *ib = b;
+
+	return strcmp(ia->input, ib->input);
+}
+
+/**
+ * Add the `.yaml` files in a directory to the batch, in name order.
+ */
+static bool batch__add_dir(struct batch *b, DIR *dir, const char *path)
+{
+	size_t path_len = strlen(path);
+	struct dirent *entry;
+
+	while ((entry = readdir(dir)) != NULL) {
+		size_t len = strlen(entry->d_name);
+		char *file;
+
+		if (len <= 5 || strcmp(entry->d_name + len - 5, ".yaml") != 0) {
+			continue;
+		}
+
+		file = malloc(path_len + len + 2);
+		if (file == NULL) {
+			return false;
+		}
+		memcpy(file, path, path_len);
+		file[path_len] = '/';
+		memcpy(file + path_len + 1, entry->d_name, len + 1);
+
+		if (!batch__add(b, file)) {
+			return false;
+		}
+	}
+
+	qsort(b->item, b->item_count, sizeof(*b->item), batch__item_cmp);
+	return true;
+}
+
+/**
+ * Add the puzzle files listed in a file to the batch.
+ *
+ * The list has a path on each line. Blank lines are skipped.
+ */
+static bool batch__add_list(struct batch *b, FILE *list)
+{
+	char *data = NULL;
+	size_t size = 0;
+	size_t len = 0;
+	size_t start = 0;
+
+	do {
+		if (len == size) {
+			char *grow = realloc(data, size + 4096);
+
+			if (grow == NULL) {
+				free(data);
+				return false;
+			}
+			data = grow;
+			size += 4096;
+		}
+		len += fread(data + len, 1, size - len, list);
+	} while (len == size);
+
+	if (ferror(list)) {
+		free(data);
+		return false;
+	}
+
+	for (size_t i = 0; i <= len; i++) {
+		size_t end = i;
+
+		if (i < len && data[i] != '\n') {
+			continue;
+		}
+
+		if (end > start && data[end - 1] == '\r') {
+			end--;
+		}
+		if (end > start && !batch__add(b,
+				batch__strndup(data + start, end - start))) {
+			free(data);
+			return false;
+		}
+		start = i + 1;
+	}
+
+	free(data);
+	return true;
+}
+
+/**
+ * Get the output path for a puzzle from the output path template.
+ *
+ * In the template, `%n` is replaced by the puzzle file's name, without its
+ * directory or extension, and `%%` by `%`.
+ *
+ * \param[in]  template  The output path template.
+ * \param[in]  input     The puzzle file path.
+ * \return the output path, or NULL on error.
+ */
+static char *batch__output_path(const char *template, const char *input)
+{
+	const char *name = strrchr(input, '/');
+	const char *ext;
+	size_t name_len;
+	size_t len = 0;
+	char *path;
+
+	name = (name != NULL) ? name + 1 : input;
+	ext = strrchr(name, '.');
+	name_len = (ext != NULL && ext != name) ?
+			(size_t)(ext - name) : strlen(name);
+
+	path = malloc(strlen(template) / 2 * name_len + strlen(template) + 1);
+	if (path == NULL) {
+		return NULL;
+	}
+
+	for (const char *t = template; *t != '\0'; t++) {
+		if (t[0] == '%' && t[1] == 'n') {
+			memcpy(path + len, name, name_len);
+			len += name_len;
+			t++;
+		} else if (t[0] == '%' && t[1] == '%') {
+			path[len++] = '%';
+			t++;
+		} else {
+			path[len++] = *t;
+		}
+	}
+	path[len] = '\0';
+
+	return path;
+}
+
+/**
+ * Worker thread callback to solve a puzzle of the current chunk.
+ */
+static void batch__solve(void *pw, size_t index, size_t thread)
+{
+	struct batch *b = pw;
+	struct batch__item *item = &b->item[b->first + index];
+	double start = batch__time();
+	struct output *output;
+	struct puzzle *puzzle;
+
+	(void)thread;
+
+	item->status = "error";
+
+	puzzle = puzzle_create(&item->options, item->input);
+	if (puzzle == NULL) {
+		item->seconds = batch__time() - start;
+		return;
+	}
+
+	output = output_create(&item->options, puzzle);
+	if (output != NULL) {
+		puzzle_set_event_fn(puzzle, output_event_cb, output);
+		if (!puzzle_solve(puzzle)) {
+			item->status = "no-solution";
+		} else if (puzzle_is_complete(puzzle)) {
+			item->status = "solved";
+		} else {
+			item->status = "stalled";
+		}
+	}
+	output_free(output);
+
+	item->passes = puzzle->pass_count;
+	item->cells = puzzle->cells_complete;
+	item->cell_count = puzzle->row_count * puzzle->col_count;
+	item->solutions = puzzle->solution_count;
+	puzzle_free(puzzle);
+
+	item->seconds = batch__time() - start;
+}
+
+/**
+ * Write a string as a JSON string.
+ */
+static void batch__json_string(FILE *f, const char *str)
+{
+	if (str == NULL) {
+		fputs("null", f);
+		return;
+	}
+
+	fputc('"', f);
+	for (; *str != '\0'; str++) {
+		unsigned char c = (unsigned char)*str;
+
+		if (c == '"' || c == '\\') {
+			fprintf(f, "\\%c", c);
+		} else if (c < 0x20) {
+			fprintf(f, "\\u%04x", c);
+		} else {
+			fputc(c, f);
+		}
+	}
+	fputc('"', f);
+}
+
+/**
+ * Write the summary line for a puzzle.
+ */
+static void batch__summary(
+		const struct batch *b,
+		FILE *f,
+		const struct batch__item *item)
+{
+	fputs("{\"input\":", f);
+	batch__json_string(f, item->input);
+	fputs(",\"output\":", f);
+	batch__json_string(f, item->output);
+	fputs(",\"status\":", f);
+	batch__json_string(f, item->status);
+	fprintf(f, ",\"seconds\":%.6f,\"passes\":%zu,"
+			"\"cells\":%zu,\"cell_count\":%zu",
+			item->seconds, item->passes,
+			item->cells, item->cell_count);
+	if (b->options->count_solutions > 0) {
+		fprintf(f, ",\"solutions\":%zu", item->solutions);
+	}
+	fputs("}\n", f);
+}
+
+/**
+ * Set up the options for solving each puzzle of the batch.
+ *
+ * Each puzzle is solved on a single thread, and its grid isn't printed.
+ */
+static bool batch__prepare(struct batch *b)
+{
+	const struct options *options = b->options;
+
+	for (size_t i = 0; i < b->item_count; i++) {
+		struct batch__item *item = &b->item[i];
+
+		item->options = *options;
+		item->options.threads = 1;
+		item->options.quiet = true;
+
+		if (options->output != NULL) {
+			item->output = batch__output_path(options->output,
+					item->input);
+			if (item->output == NULL) {
+				return false;
+			}
+		}
+		item->options.output = item->output;
+	}
+
+	return true;
+}
+
+/**
+ * Load the list of puzzle files for the batch.
+ */
+static bool batch__load(struct batch *b, const char *path)
+{
+	DIR *dir = opendir(path);
+	FILE *list;
+	bool ok;
+
+	if (dir != NULL) {
+		ok = batch__add_dir(b, dir, path);
+		closedir(dir);
+		return ok;
+	}
+
+	list = fopen(path, "r");
+	if (list == NULL) {
+		fprintf(stderr, "Error: Failed to open batch: '%s'\n", path);
+		return false;
+	}
+
+	ok = batch__add_list(b, list);
+	fclose(list);
+	return ok;
+}
+
+static void batch__free(struct batch *b)
+{
+	for (size_t i = 0; i < b->item_count; i++) {
+		free(b->item[i].input);
+		free(b->item[i].output);
+	}
+	free(b->item);
+}
+
+int batch_run(const struct options *options)
+{
+	struct batch b = { .options = options };
+	size_t thread_count = (options->threads > 1) ?
+			(size_t)options->threads : 1;
+	size_t chunk = thread_count * BATCH__JOBS_PER_THREAD;
+	int exit_code = EXIT_SUCCESS;
+	struct pool *pool = NULL;
+	FILE *summary = stdout;
+
+	if (options->output != NULL && strstr(options->output, "%n") == NULL) {
+		fprintf(stderr, "Error: Batch output path must contain "
+				"'%%n' for the puzzle name!\n");
+		return EXIT_FAILURE;
+	}
+
+	if (!batch__load(&b, options->batch) || !batch__prepare(&b)) {
+		fprintf(stderr, "Error: Failed to set up batch!\n");
+		exit_code = EXIT_FAILURE;
+		goto exit;
+	}
+
+	if (options->summary != NULL) {
+		summary = fopen(options->summary, "w");
+		if (summary == NULL) {
+			fprintf(stderr, "Error: Failed to open summary: '%s'\n",
+					options->summary);
+			exit_code = EXIT_FAILURE;
+			goto exit;
+		}
+	}
+
+	pool = pool_create(thread_count);
+	if (pool == NULL) {
+		exit_code = EXIT_FAILURE;
+		goto exit;
+	}
+
+	for (b.first = 0; b.first < b.item_count; b.first += chunk) {
+		size_t count = b.item_count - b.first;
+
+		if (count > chunk) {
+			count = chunk;
+		}
+
+		pool_run(pool, count, batch__solve, &b);
+
+		for (size_t i = b.first; i < b.first + count; i++) {
+			batch__summary(&b, summary, &b.item[i]);
+			if (strcmp(b.item[i].status, "solved") != 0) {
+				exit_code = EXIT_FAILURE;
+			}
+		}
+		fflush(summary);
+	}
+
+exit:
+	if (summary != stdout && summary != NULL) {
+		fclose(summary);
+	}
+	pool_free(pool);
+	batch__free(&b);
+	return exit_code;
+}
@@ -0,0 +1,31 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Solving many puzzle files in one run.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+struct options;
+
+/**
+ * Solve every puzzle file of a batch.
+ *
+ * The batch is the options' batch path: Either a directory, whose `.yaml`
+ * files are solved in name order, or a file listing a puzzle file path on
+ * each line. Puzzles are solved on the options' number of threads, one
+ * puzzle per thread. A line of JSON describing each puzzle's outcome is
+ * written to the summary path, or to stdout.
+ *
+ * \param[in]  options  The options.
+ * \return the exit status: Success if every puzzle was solved.
+ */
+int batch_run(const struct options *options);
+
+#endif /* BATCH_H */
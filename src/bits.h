@@ -0,0 +1,246 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Packed bit array helpers.
+ *
+ * Bit arrays are stored in uint64_t words, with bit `i` in word `i / 64`.
+ * A line of up to 64 slots fits in a single word.
+ */
+
+#ifndef BITS_H
+#define BITS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define BITS_WORD_BITS 64
+
+/**
+ * Get the number of words needed for a bit array.
+ *
+ * \param[in]  count  Number of bits.
+ * \return number of words.
+ */
+static inline size_t bits_words(size_t count)
+{
+	return (count + BITS_WORD_BITS - 1) / BITS_WORD_BITS;
+}
+
+/**
+ * Get a mask with bits [start, end) of a word set.
+ *
+ * \param[in]  start  First bit in mask.
+ * \param[in]  end    One past last bit in mask, at most 64.
+ * \return the mask.
+ */
+static inline uint64_t bits_mask(size_t start, size_t end)
+{
+	uint64_t high = (end == BITS_WORD_BITS) ?
+			~(uint64_t)0 : ((uint64_t)1 << end) - 1;
+
+	return high & ~(((uint64_t)1 << start) - 1);
+}
+
+static inline bool bits_test(const uint64_t *bits, size_t i)
+{
+	return (bits[i / BITS_WORD_BITS] >> (i % BITS_WORD_BITS)) & 1;
+}
+
+static inline void bits_set(uint64_t *bits, size_t i)
+{
+	bits[i / BITS_WORD_BITS] |= (uint64_t)1 << (i % BITS_WORD_BITS);
+}
+
+static inline void bits_clear(uint64_t *bits, size_t i)
+{
+	bits[i / BITS_WORD_BITS] &= ~((uint64_t)1 << (i % BITS_WORD_BITS));
+}
+
+/**
+ * Set all bits in a range.
+ *
+ * \param[in]  bits   Bit array to update.
+ * \param[in]  start  First bit to set.
+ * \param[in]  end    One past last bit to set.
+ */
+static inline void bits_set_range(uint64_t *bits, size_t start, size_t end)
+{
+	size_t w_start = start / BITS_WORD_BITS;
+	size_t w_end = end / BITS_WORD_BITS;
+
+	if (start >= end) {
+		return;
+	}
+
+	if (w_start == w_end) {
+		bits[w_start] |= bits_mask(start % BITS_WORD_BITS,
+				end % BITS_WORD_BITS);
+		return;
+	}
+
+	bits[w_start] |= bits_mask(start % BITS_WORD_BITS, BITS_WORD_BITS);
+	for (size_t w = w_start + 1; w < w_end; w++) {
+		bits[w] = ~(uint64_t)0;
+	}
+	if (end % BITS_WORD_BITS != 0) {
+		bits[w_end] |= bits_mask(0, end % BITS_WORD_BITS);
+	}
+}
+
+/**
+ * Check whether any bit in a range is set.
+ *
+ * \param[in]  bits   Bit array to check.
+ * \param[in]  start  First bit to check.
+ * \param[in]  end    One past last bit to check.
+ * \return true if any bit in the range is set.
+ */
+static inline bool bits_any(const uint64_t *bits, size_t start, size_t end)
+{
+	size_t w_start = start / BITS_WORD_BITS;
+	size_t w_end = end / BITS_WORD_BITS;
+
+	if (start >= end) {
+		return false;
+	}
+
+	if (w_start == w_end) {
+		return bits[w_start] & bits_mask(start % BITS_WORD_BITS,
+				end % BITS_WORD_BITS);
+	}
+
+	if (bits[w_start] & bits_mask(start % BITS_WORD_BITS, BITS_WORD_BITS)) {
+		return true;
+	}
+	for (size_t w = w_start + 1; w < w_end; w++) {
+		if (bits[w] != 0) {
+			return true;
+		}
+	}
+	if (end % BITS_WORD_BITS != 0) {
+		return bits[w_end] & bits_mask(0, end % BITS_WORD_BITS);
+	}
+
+	return false;
+}
+
+/**
+ * Find the first set bit at or after a position.
+ *
+ * \param[in]  bits   Bit array to search.
+ * \param[in]  start  First bit to consider.
+ * \param[in]  end    One past last bit to consider.
+ * \return index of the first set bit, or `end` if there is none.
+ */
+static inline size_t bits_find(const uint64_t *bits, size_t start, size_t end)
+{
+	size_t w = start / BITS_WORD_BITS;
+	size_t w_end = bits_words(end);
+	uint64_t word;
+
+	if (start >= end) {
+		return end;
+	}
+
+	word = bits[w] & ~(((uint64_t)1 << (start % BITS_WORD_BITS)) - 1);
+	while (word == 0) {
+		if (++w >= w_end) {
+			return end;
+		}
+		word = bits[w];
+	}
+
+	start = w * BITS_WORD_BITS + (size_t)__builtin_ctzll(word);
+	return (start < end) ? start : end;
+}
+
+/**
+ * Copy a range of bits to the start of another bit array.
+ *
+ * \param[out] dst    Bit array to copy to, from bit 0.
+ * \param[in]  src    Bit array to copy from.
+ * \param[in]  start  First bit to copy.
+ * \param[in]  end    One past last bit to copy.
+ */
+static inline void bits_extract(
+		uint64_t *dst,
+		const uint64_t *src,
+		size_t start,
+		size_t end)
+{
+	size_t shift = start % BITS_WORD_BITS;
+	size_t first = start / BITS_WORD_BITS;
+	size_t words = bits_words(end - start);
+	size_t src_words = bits_words(end);
+
+	for (size_t w = 0; w < words; w++) {
+		uint64_t word = src[first + w] >> shift;
+
+		if (shift != 0 && first + w + 1 < src_words) {
+			word |= src[first + w + 1] << (BITS_WORD_BITS - shift);
+		}
+		dst[w] = word;
+	}
+
+	if ((end - start) % BITS_WORD_BITS != 0) {
+		dst[words - 1] &= bits_mask(0, (end - start) % BITS_WORD_BITS);
+	}
+}
+
+/**
+ * Check whether any bit set in one array is not set in another.
+ *
+ * \param[in]  a      Bit array to check.
+ * \param[in]  b      Bit array of bits allowed to be set in `a`.
+ * \param[in]  words  Number of words in the arrays.
+ * \return true if `a & ~b` has any bit set.
+ */
+static inline bool bits_any_andnot(
+		const uint64_t *a,
+		const uint64_t *b,
+		size_t words)
+{
+	size_t w = 0;
+
+#if defined(__AVX2__)
+	for (; w + 4 <= words; w += 4) {
+		__m256i va = _mm256_loadu_si256((const void *)(a + w));
+		__m256i vb = _mm256_loadu_si256((const void *)(b + w));
+
+		if (!_mm256_testc_si256(vb, va)) {
+			return true;
+		}
+	}
+#endif
+#if defined(__SSE2__)
+	for (; w + 2 <= words; w += 2) {
+		__m128i va = _mm_loadu_si128((const void *)(a + w));
+		__m128i vb = _mm_loadu_si128((const void *)(b + w));
+		__m128i x = _mm_andnot_si128(vb, va);
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(x,
+				_mm_setzero_si128())) != 0xFFFF) {
+			return true;
+		}
+	}
+#endif
+	for (; w < words; w++) {
+		if (a[w] & ~b[w]) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+#endif /* BITS_H */
@@ -0,0 +1,246 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Bounded least-recently-used key/value cache.
+ *
+ * Entries are kept in a chained hash table, and on a list in order of use.
+ * When adding an entry would take the cache over its memory limit, entries
+ * are dropped from the least recently used end of the list.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "cache.h"
+
+/** Expected size of an entry, used to size the hash table. */
+#define CACHE__ENTRY_SIZE 256
+
+/** A cache entry, followed by its key and then its value. */
+struct cache__entry {
+	struct cache__entry *chain; /**< Next entry in the hash bucket. */
+	struct cache__entry *newer; /**< More recently used entry. */
+	struct cache__entry *older; /**< Less recently used entry. */
+
+	uint64_t hash;    /**< Hash of the key. */
+	size_t key_len;   /**< Length of key in bytes. */
+	size_t value_len; /**< Length of value in bytes. */
+
+	uint8_t data[];   /**< The key, then the value. */
+};
+
+struct cache {
+	struct cache__entry **bucket; /**< Hash table of entry chains. */
+	size_t bucket_mask;           /**< Number of buckets, minus one. */
+
+	struct cache__entry *newest; /**< Most recently used entry. */
+	struct cache__entry *oldest; /**< Least recently used entry. */
+
+	size_t bytes_max; /**< Most memory the entries may use. */
+
+	struct cache_stats stats;
+};
+
+/**
+ * Hash a key, with FNV-1a.
+ */
+static uint64_t cache__hash(const void *key, size_t key_len)
+{
+	const uint8_t *data = key;
+	uint64_t hash = 0xcbf29ce484222325;
+
+	for (size_t i = 0; i < key_len; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3;
+	}
+
+	return hash;
+}
+
+/**
+ * Get the memory used by an entry.
+ */
+static inline size_t cache__entry_size(const struct cache__entry *e)
+{
+	return sizeof(*e) + e->key_len + e->value_len;
+}
+
+/**
+ * Take an entry off the list in order of use.
+ */
+static void cache__unlink(struct cache *cache, struct cache__entry *e)
+{
+	if (e->newer != NULL) {
+		e->newer->older = e->older;
+	} else {
+		cache->newest = e->older;
+	}
+
+	if (e->older != NULL) {
+		e->older->newer = e->newer;
+	} else {
+		cache->oldest = e->newer;
+	}
+}
+
+/**
+ * Put an entry on the most recently used end of the list.
+ */
+static void cache__link(struct cache *cache, struct cache__entry *e)
+{
+	e->newer = NULL;
+	e->older = cache->newest;
+	if (cache->newest != NULL) {
+		cache->newest->newer = e;
+	} else {
+		cache->oldest = e;
+	}
+	cache->newest = e;
+}
+
+/**
+ * Drop the least recently used entry.
+ */
+static void cache__evict(struct cache *cache)
+{
+	struct cache__entry *e = cache->oldest;
+	struct cache__entry **pos;
+
+	pos = &cache->bucket[e->hash & cache->bucket_mask];
+	while (*pos != e) {
+		pos = &(*pos)->chain;
+	}
+	*pos = e->chain;
+
+	cache__unlink(cache, e);
+	cache->stats.bytes -= cache__entry_size(e);
+	cache->stats.entries--;
+	cache->stats.evictions++;
+	free(e);
+}
+
+struct cache *cache_create(size_t bytes_max)
+{
+	struct cache *cache;
+	size_t buckets = 16;
+
+	cache = calloc(1, sizeof(*cache));
+	if (cache == NULL) {
+		return NULL;
+	}
+
+	while (buckets < bytes_max / CACHE__ENTRY_SIZE) {
+		buckets *= 2;
+	}
+
+	cache->bucket = calloc(buckets, sizeof(*cache->bucket));
+	if (cache->bucket == NULL) {
+		free(cache);
+		return NULL;
+	}
+
+	cache->bucket_mask = buckets - 1;
+	cache->bytes_max = bytes_max;
+	return cache;
+}
+
+const void *cache_find(
+		struct cache *cache,
+		const void *key,
+		size_t key_len,
+		size_t *value_len)
+{
+	uint64_t hash = cache__hash(key, key_len);
+	struct cache__entry *e = cache->bucket[hash & cache->bucket_mask];
+
+	cache->stats.lookups++;
+
+	for (; e != NULL; e = e->chain) {
+		if (e->hash == hash && e->key_len == key_len &&
+		    memcmp(e->data, key, key_len) == 0) {
+			break;
+		}
+	}
+
+	if (e == NULL) {
+		return NULL;
+	}
+
+	cache__unlink(cache, e);
+	cache__link(cache, e);
+	cache->stats.hits++;
+
+	*value_len = e->value_len;
+	return e->data + e->key_len;
+}
+
+bool cache_insert(
+		struct cache *cache,
+		const void *key,
+		size_t key_len,
+		const void *value,
+		size_t value_len)
+{
+	size_t size = sizeof(struct cache__entry) + key_len + value_len;
+	struct cache__entry *e;
+	size_t b;
+
+	if (size > cache->bytes_max) {
+		return true;
+	}
+
+	while (cache->stats.bytes + size > cache->bytes_max) {
+		cache__evict(cache);
+	}
+
+	e = malloc(size);
+	if (e == NULL) {
+		return false;
+	}
+
+	e->hash = cache__hash(key, key_len);
+	e->key_len = key_len;
+	e->value_len = value_len;
+	memcpy(e->data, key, key_len);
+	memcpy(e->data + key_len, value, value_len);
+
+	b = e->hash & cache->bucket_mask;
+	e->chain = cache->bucket[b];
+	cache->bucket[b] = e;
+	cache__link(cache, e);
+
+	cache->stats.bytes += size;
+	cache->stats.entries++;
+	cache->stats.inserts++;
+	return true;
+}
+
+const struct cache_stats *cache_get_stats(const struct cache *cache)
+{
+	return &cache->stats;
+}
+
+void cache_free(struct cache *cache)
+{
+	if (cache != NULL) {
+		struct cache__entry *e = cache->oldest;
+
+		while (e != NULL) {
+			struct cache__entry *newer = e->newer;
+
+			free(e);
+			e = newer;
+		}
+
+		free(cache->bucket);
+		free(cache);
+	}
+}
@@ -0,0 +1,85 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Bounded least-recently-used key/value cache.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+struct cache;
+
+/** Cache statistics. */
+struct cache_stats {
+	uint64_t lookups;   /**< Number of lookups. */
+	uint64_t hits;      /**< Number of lookups that found an entry. */
+	uint64_t inserts;   /**< Number of entries added. */
+	uint64_t evictions; /**< Number of entries dropped to make room. */
+	uint64_t entries;   /**< Number of entries held. */
+	uint64_t bytes;     /**< Memory used by the entries held. */
+};
+
+/**
+ * Create a cache.
+ *
+ * \param[in]  bytes_max  Most memory the cache's entries may use.
+ * \return a new cache, or NULL on error.
+ */
+struct cache *cache_create(size_t bytes_max);
+
+/**
+ * Find a cache entry.
+ *
+ * \param[in]  cache      The cache to search.
+ * \param[in]  key        The key to find.
+ * \param[in]  key_len    Length of key in bytes.
+ * \param[out] value_len  Returns the length of the value in bytes.
+ * \return the value, valid until the next insert, or NULL if not found.
+ */
+const void *cache_find(
+		struct cache *cache,
+		const void *key,
+		size_t key_len,
+		size_t *value_len);
+
+/**
+ * Add an entry to a cache.
+ *
+ * The least recently used entries are dropped to make room for it. The
+ * key must not already be in the cache.
+ *
+ * \param[in]  cache      The cache to add the entry to.
+ * \param[in]  key        The entry's key.
+ * \param[in]  key_len    Length of key in bytes.
+ * \param[in]  value      The entry's value.
+ * \param[in]  value_len  Length of value in bytes.
+ * \return true on success, or false on error.
+ */
+bool cache_insert(
+		struct cache *cache,
+		const void *key,
+		size_t key_len,
+		const void *value,
+		size_t value_len);
+
+/**
+ * Get the statistics of a cache.
+ *
+ * \param[in]  cache  The cache.
+ * \return the cache's statistics.
+ */
+const struct cache_stats *cache_get_stats(const struct cache *cache);
+
+/**
+ * Destroy a cache.
+ *
+ * \param[in]  cache  The cache to destroy.
+ */
+void cache_free(struct cache *cache);
+
+#endif /* CACHE_H */
@@ -0,0 +1,499 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Built-in GIF encoder.
+ *
+ * Frames are queued until there are a few for each thread, and then
+ * compressed at once on a worker thread pool. The compressed frames are
+ * written to the file in the order they were added.
+ *
+ * Each frame only holds the rectangle of the image that has changed, drawn
+ * over the previous frame. Codes start at the smallest size the palette
+ * allows, so a three colour palette starts with 3 bit codes.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "gif.h"
+#include "pool.h"
+
+/** Number of frames compressed per thread at a time. */
+#define GIF__FRAMES_PER_THREAD 4
+
+/** Largest LZW code size, in bits. */
+#define GIF__CODE_BITS 12
+
+/** Number of LZW codes. */
+#define GIF__CODES (1 << GIF__CODE_BITS)
+
+/** Log2 of number of entries in the LZW string table's hash table. */
+#define GIF__HASH_BITS 13
+
+/** Largest GIF data sub-block. */
+#define GIF__BLOCK_MAX 255
+
+/** An LZW string table entry: a known string plus one more pixel. */
+struct gif__entry {
+	uint32_t key;  /**< Prefix code and pixel, as (code << 8 | pixel). */
+	uint16_t code; /**< Code for the string. */
+	uint16_t gen;  /**< Table generation the entry belongs to. */
+};
+
+/** A thread's LZW string table. */
+struct gif__lzw {
+	/** Hash table of the strings, by key. */
+	struct gif__entry entry[1 << GIF__HASH_BITS];
+	/** Current generation. Older entries are empty. */
+	uint16_t gen;
+};
+
+/** A frame waiting to be written. */
+struct gif__frame {
+	struct gif_rect rect; /**< Where the frame goes in the image. */
+	uint16_t delay;       /**< Time to show the frame for (cs). */
+
+	uint8_t *pixels;    /**< The frame's pixels. */
+	size_t pixels_cap;  /**< Allocated bytes in pixels. */
+
+	uint8_t *data;    /**< Compressed pixels, without sub-block sizes. */
+	size_t data_len;  /**< Number of bytes used in data. */
+	size_t data_cap;  /**< Allocated bytes in data. */
+	bool ok;          /**< Whether the frame was compressed. */
+};
+
+/** LZW bit writer for a frame. */
+struct gif__bits {
+	struct gif__frame *frame; /**< The frame being compressed. */
+	uint32_t acc;             /**< Bits not yet written. */
+	unsigned count;           /**< Number of bits in acc. */
+};
+
+struct gif {
+	FILE *f;                  /**< The GIF file. */
+	struct gif_config config; /**< The GIF file settings. */
+	uint8_t code_size;        /**< LZW minimum code size. */
+	bool ok;                  /**< Whether everything has been written. */
+
+	struct pool *pool;   /**< Threads to compress frames on. */
+	struct gif__lzw *lzw; /**< String table for each thread. */
+
+	struct gif__frame *frame; /**< Frames waiting to be written. */
+	size_t frame_count;       /**< Number of frames waiting. */
+	size_t frame_cap;         /**< Frames compressed in one go. */
+	bool started;             /**< Whether a frame has been added. */
+};
+
+/**
+ * Empty a string table.
+ */
+static void gif__lzw_reset(struct gif__lzw *lzw)
+{
+	if (++lzw->gen == 0) {
+		memset(lzw->entry, 0, sizeof(lzw->entry));
+		lzw->gen = 1;
+	}
+}
+
+/**
+ * Find a string's entry in a string table, or where it would go.
+ */
+static inline struct gif__entry *gif__lzw_find(
+		struct gif__lzw *lzw,
+		uint32_t key)
+{
+	uint32_t mask = (1 << GIF__HASH_BITS) - 1;
+	uint32_t i = (key * 2654435761u) >> (32 - GIF__HASH_BITS);
+
+	while (lzw->entry[i].gen == lzw->gen && lzw->entry[i].key != key) {
+		i = (i + 1) & mask;
+	}
+
+	return &lzw->entry[i];
+}
+
+/**
+ * Append a byte to a frame's compressed data.
+ */
+static inline bool gif__data_put(struct gif__frame *fr, uint8_t byte)
+{
+	if (fr->data_len == fr->data_cap) {
+		size_t cap = (fr->data_cap > 0) ? fr->data_cap * 2 : 4096;
+		uint8_t *data = realloc(fr->data, cap);
+
+		if (data == NULL) {
+			return false;
+		}
+		fr->data = data;
+		fr->data_cap = cap;
+	}
+
+	fr->data[fr->data_len++] = byte;
+	return true;
+}
+
+/**
+ * Write an LZW code.
+ */
+static inline bool gif__bits_put(
+		struct gif__bits *b,
+		unsigned code,
+		unsigned size)
+{
+	b->acc |= (uint32_t)code << b->count;
+	b->count += size;
+
+	while (b->count >= 8) {
+		if (!gif__data_put(b->frame, (uint8_t)b->acc)) {
+			return false;
+		}
+		b->acc >>= 8;
+		b->count -= 8;
+	}
+
+	return true;
+}
+
+/**
+ * Write any bits left over, padded to a whole byte.
+ */
+static bool gif__bits_flush(struct gif__bits *b)
+{
+	if (b->count > 0) {
+		return gif__data_put(b->frame, (uint8_t)b->acc);
+	}
+
+	return true;
+}
+
+/**
+ * LZW compress a frame's pixels.
+ *
+ * When the string table is full, a clear code is written and it starts
+ * again. The code size grows as soon as the decoder's next code needs the
+ * extra bit.
+ *
+ * \param[in]  lzw        A string table to use.
+ * \param[in]  fr         The frame to compress.
+ * \param[in]  code_size  The LZW minimum code size.
+ * \return true on success, or false on error.
+ */
+static bool gif__compress(
+		struct gif__lzw *lzw,
+		struct gif__frame *fr,
+		uint8_t code_size)
+{
+	struct gif__bits b = { .frame = fr };
+	size_t count = (size_t)fr->rect.w * fr->rect.h;
+	unsigned clear = 1u << code_size;
+	unsigned end = clear + 1;
+	unsigned size = code_size + 1u;
+	unsigned next = end + 1;
+	unsigned prefix;
+
+	fr->data_len = 0;
+	gif__lzw_reset(lzw);
+
+	if (!gif__bits_put(&b, clear, size)) {
+		return false;
+	}
+
+	prefix = fr->pixels[0];
+	for (size_t i = 1; i < count; i++) {
+		uint32_t key = (uint32_t)prefix << 8 | fr->pixels[i];
+		struct gif__entry *e = gif__lzw_find(lzw, key);
+
+		if (e->gen == lzw->gen) {
+			prefix = e->code;
+			continue;
+		}
+
+		if (!gif__bits_put(&b, prefix, size)) {
+			return false;
+		}
+
+		if (next < GIF__CODES) {
+			if (next == 1u << size) {
+				size++;
+			}
+			e->key = key;
+			e->code = (uint16_t)next++;
+			e->gen = lzw->gen;
+		} else {
+			if (!gif__bits_put(&b, clear, size)) {
+				return false;
+			}
+			gif__lzw_reset(lzw);
+			size = code_size + 1u;
+			next = end + 1;
+		}
+
+		prefix = fr->pixels[i];
+	}
+
+	if (!gif__bits_put(&b, prefix, size)) {
+		return false;
+	}
+
+	/* The decoder adds a code for the last one, which may grow the size. */
+	if (next == 1u << size && size < GIF__CODE_BITS) {
+		size++;
+	}
+
+	return gif__bits_put(&b, end, size) && gif__bits_flush(&b);
+}
+
+/**
+ * Worker thread callback to compress a waiting frame.
+ */
+static void gif__compress_job(void *pw, size_t index, size_t thread)
+{
+	struct gif *gif = pw;
+	struct gif__frame *fr = &gif->frame[index];
+
+	fr->ok = gif__compress(&gif->lzw[thread], fr, gif->code_size);
+}
+
+/**
+ * Write bytes to the GIF file.
+ */
+static void gif__write(struct gif *gif, const void *data, size_t len)
+{
+	if (gif->ok && fwrite(data, 1, len, gif->f) != len) {
+		fprintf(stderr, "Error: Failed to write GIF: '%s'\n",
+				gif->config.path);
+		gif->ok = false;
+	}
+}
+
+/**
+ * Write a 16-bit little endian value to the GIF file.
+ */
+static void gif__write_u16(struct gif *gif, uint16_t value)
+{
+	uint8_t data[2] = { (uint8_t)value, (uint8_t)(value >> 8) };
+
+	gif__write(gif, data, sizeof(data));
+}
+
+/**
+ * Write a compressed frame to the GIF file.
+ */
+static void gif__frame_write(struct gif *gif, const struct gif__frame *fr)
+{
+	if (gif->config.animated) {
+		/* Graphic control: leave the frame in place for the next. */
+		uint8_t gce[] = { 0x21, 0xF9, 0x04, 0x04 };
+
+		gif__write(gif, gce, sizeof(gce));
+		gif__write_u16(gif, fr->delay);
+		gif__write(gif, (uint8_t[]) { 0x00, 0x00 }, 2);
+	}
+
+	gif__write(gif, (uint8_t[]) { 0x2C }, 1);
+	gif__write_u16(gif, fr->rect.x);
+	gif__write_u16(gif, fr->rect.y);
+	gif__write_u16(gif, fr->rect.w);
+	gif__write_u16(gif, fr->rect.h);
+	gif__write(gif, (uint8_t[]) { 0x00, gif->code_size }, 2);
+
+	for (size_t i = 0; i < fr->data_len; i += GIF__BLOCK_MAX) {
+		size_t len = fr->data_len - i;
+
+		if (len > GIF__BLOCK_MAX) {
+			len = GIF__BLOCK_MAX;
+		}
+		gif__write(gif, (uint8_t[]) { (uint8_t)len }, 1);
+		gif__write(gif, fr->data + i, len);
+	}
+	gif__write(gif, (uint8_t[]) { 0x00 }, 1);
+}
+
+/**
+ * Compress and write the waiting frames.
+ */
+static bool gif__flush(struct gif *gif)
+{
+	pool_run(gif->pool, gif->frame_count, gif__compress_job, gif);
+
+	for (size_t i = 0; i < gif->frame_count; i++) {
+		if (!gif->frame[i].ok) {
+			fprintf(stderr, "Error: Failed to compress GIF frame!\n");
+			gif->ok = false;
+		}
+		gif__frame_write(gif, &gif->frame[i]);
+	}
+
+	gif->frame_count = 0;
+	return gif->ok;
+}
+
+/**
+ * Write the GIF header, palette, and loop count.
+ */
+static void gif__header_write(struct gif *gif)
+{
+	const struct gif_config *c = &gif->config;
+	uint8_t bits = 1;
+	uint8_t palette[3 * 256] = { 0 };
+
+	while ((1u << bits) < c->palette_count) {
+		bits++;
+	}
+	gif->code_size = (bits < 2) ? 2 : bits;
+
+	gif__write(gif, "GIF89a", 6);
+	gif__write_u16(gif, c->width);
+	gif__write_u16(gif, c->height);
+	gif__write(gif, (uint8_t[]) {
+		(uint8_t)(0x80 | 0x70 | (bits - 1)), 0x00, 0x00 }, 3);
+
+	memcpy(palette, c->palette, 3u * c->palette_count);
+	gif__write(gif, palette, 3u << bits);
+
+	if (c->animated) {
+		gif__write(gif, (uint8_t[]) { 0x21, 0xFF, 0x0B }, 3);
+		gif__write(gif, "NETSCAPE2.0", 11);
+		gif__write(gif, (uint8_t[]) { 0x03, 0x01 }, 2);
+		gif__write_u16(gif, c->loops);
+		gif__write(gif, (uint8_t[]) { 0x00 }, 1);
+	}
+}
+
+static void gif__free(struct gif *gif)
+{
+	if (gif->frame != NULL) {
+		for (size_t i = 0; i < gif->frame_cap; i++) {
+			free(gif->frame[i].pixels);
+			free(gif->frame[i].data);
+		}
+		free(gif->frame);
+	}
+
+	if (gif->f != NULL) {
+		fclose(gif->f);
+	}
+
+	pool_free(gif->pool);
+	free(gif->lzw);
+	free(gif);
+}
+
+struct gif *gif_create(const struct gif_config *config)
+{
+	size_t threads = (config->threads > 1) ? config->threads : 1;
+	struct gif *gif;
+
+	gif = calloc(1, sizeof(*gif));
+	if (gif == NULL) {
+		return NULL;
+	}
+
+	gif->ok = true;
+	gif->config = *config;
+	gif->frame_cap = (threads > 1) ? threads * GIF__FRAMES_PER_THREAD : 1;
+
+	gif->frame = calloc(gif->frame_cap, sizeof(*gif->frame));
+	gif->lzw = calloc(threads, sizeof(*gif->lzw));
+	gif->pool = pool_create(threads);
+	if (gif->frame == NULL || gif->lzw == NULL || gif->pool == NULL) {
+		gif__free(gif);
+		return NULL;
+	}
+
+	gif->f = fopen(config->path, "wb");
+	if (gif->f == NULL) {
+		fprintf(stderr, "Error: Failed to open GIF: '%s'\n",
+				config->path);
+		gif__free(gif);
+		return NULL;
+	}
+
+	gif__header_write(gif);
+	if (!gif->ok) {
+		gif__free(gif);
+		return NULL;
+	}
+
+	return gif;
+}
+
+bool gif_add_frame(
+		struct gif *gif,
+		const uint8_t *data,
+		const struct gif_rect *rect,
+		uint16_t delay)
+{
+	struct gif__frame *fr = &gif->frame[gif->frame_count];
+	struct gif_rect full = {
+		.w = gif->config.width,
+		.h = gif->config.height,
+	};
+	size_t size;
+
+	if (!gif->started) {
+		/* There is nothing under the first frame to draw over. */
+		rect = &full;
+		gif->started = true;
+	}
+
+	size = (size_t)rect->w * rect->h;
+
+	if (size > fr->pixels_cap) {
+		uint8_t *pixels = realloc(fr->pixels, size);
+
+		if (pixels == NULL) {
+			return false;
+		}
+		fr->pixels = pixels;
+		fr->pixels_cap = size;
+	}
+
+	for (size_t y = 0; y < rect->h; y++) {
+		memcpy(fr->pixels + y * rect->w,
+				data + (rect->y + y) * (size_t)gif->config.width +
+				rect->x, rect->w);
+	}
+	fr->rect = *rect;
+	fr->delay = delay;
+
+	if (++gif->frame_count == gif->frame_cap) {
+		return gif__flush(gif);
+	}
+
+	return gif->ok;
+}
+
+bool gif_close(struct gif *gif)
+{
+	bool ok;
+
+	if (gif == NULL) {
+		return true;
+	}
+
+	if (gif->frame_count > 0) {
+		gif__flush(gif);
+	}
+
+	gif__write(gif, (uint8_t[]) { 0x3B }, 1);
+
+	ok = gif->ok;
+	if (fclose(gif->f) != 0) {
+		fprintf(stderr, "Error: Failed to write GIF: '%s'\n",
+				gif->config.path);
+		ok = false;
+	}
+	gif->f = NULL;
+
+	gif__free(gif);
+	return ok;
+}
@@ -0,0 +1,72 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Built-in GIF encoder.
+ */
+
+#ifndef GIF_H
+#define GIF_H
+
+struct gif;
+
+/** GIF file settings. */
+struct gif_config {
+	const char *path;       /**< Path to write the GIF to. */
+	const uint8_t *palette; /**< RGB triplets, palette_count of them. */
+	uint16_t palette_count; /**< Number of palette entries, up to 256. */
+	uint16_t width;         /**< Image width in pixels. */
+	uint16_t height;        /**< Image height in pixels. */
+	uint16_t loops;         /**< Animation loop count, or 0 for forever. */
+	bool animated;          /**< Whether frames have delays and loop. */
+	size_t threads;         /**< Number of threads to compress frames on. */
+};
+
+/** A rectangle of pixels. */
+struct gif_rect {
+	uint16_t x; /**< Left edge. */
+	uint16_t y; /**< Top edge. */
+	uint16_t w; /**< Width. */
+	uint16_t h; /**< Height. */
+};
+
+/**
+ * Create a GIF file.
+ *
+ * \param[in]  config  The GIF file settings.
+ * \return a new GIF, or NULL on error.
+ */
+struct gif *gif_create(const struct gif_config *config);
+
+/**
+ * Add a frame to a GIF.
+ *
+ * Only the given rectangle of the image is stored in the frame, over the
+ * previous frame, except for the first frame, which holds the whole image.
+ * Frames may be compressed later, in batches.
+ *
+ * \param[in]  gif    The GIF to add a frame to.
+ * \param[in]  data   Palette index of every pixel of the image, row by row.
+ * \param[in]  rect   The part of the image that has changed.
+ * \param[in]  delay  Time to show the frame for (cs).
+ * \return true on success, or false on error.
+ */
+bool gif_add_frame(
+		struct gif *gif,
+		const uint8_t *data,
+		const struct gif_rect *rect,
+		uint16_t delay);
+
+/**
+ * Finish and close a GIF file.
+ *
+ * \param[in]  gif  The GIF to close.
+ * \return true on success, or false on error.
+ */
+bool gif_close(struct gif *gif);
+
+#endif /* GIF_H */
@@ -5,14 +5,22 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
 
 #include <cyaml/cyaml.h>
 
 #include "load.h"
+#include "arena.h"
 #include "puzzle.h"
 
+/** Arena bytes to allow per byte of YAML, for the loaded puzzle data. */
+#define LOAD__ARENA_SCALE 8
+
+/** Smallest arena block size. */
+#define LOAD__ARENA_MIN 4096
+
 static const cyaml_schema_value_t schema_puzzle_line_entry = {
 	CYAML_VALUE_UINT(CYAML_FLAG_DEFAULT, size_t),
 };
@@ -46,23 +54,68 @@ static const cyaml_schema_value_t schema = {
 			struct puzzle, schema_puzzle_fields),
 };
 
+/**
+ * Memory allocation callback for libcyaml, allocating from an arena.
+ */
+static void *load__mem(void *ctx, void *ptr, size_t size)
+{
+	return arena_realloc(ctx, ptr, size);
+}
+
 static const cyaml_config_t cfg = {
 	.log_fn = cyaml_log,            /* Use the default logging function. */
-	.mem_fn = cyaml_mem,            /* Use the default memory allocator. */
+	.mem_fn = load__mem,            /* Allocate from the puzzle's arena. */
 	.log_level = CYAML_LOG_WARNING, /* Logging errors and warnings only. */
 };
 
+/**
+ * Get the size of a file, or 0 if it can't be found.
+ */
+static size_t load__file_size(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	long size = 0;
+
+	if (f != NULL) {
+		if (fseek(f, 0, SEEK_END) == 0) {
+			size = ftell(f);
+		}
+		fclose(f);
+	}
+
+	return (size > 0) ? (size_t)size : 0;
+}
+
 struct puzzle *load_file(
 		const char *path)
 {
+	cyaml_config_t config = cfg;
+	struct arena *arena;
 	cyaml_err_t err;
 	struct puzzle *p;
+	size_t size;
+
+	size = load__file_size(path);
+	if (size > SIZE_MAX / LOAD__ARENA_SCALE - LOAD__ARENA_MIN) {
+		fprintf(stderr, "ERROR: Puzzle file too large\n");
+		return NULL;
+	}
+
+	arena = arena_create(size * LOAD__ARENA_SCALE + LOAD__ARENA_MIN);
+	if (arena == NULL) {
+		fprintf(stderr, "ERROR: Allocation failed\n");
+		return NULL;
+	}
 
-	err = cyaml_load_file(path, &cfg, &schema, (cyaml_data_t **)&p, NULL);
+	config.mem_ctx = arena;
+	err = cyaml_load_file(path, &config, &schema,
+			(cyaml_data_t **)&p, NULL);
 	if (err != CYAML_OK) {
 		fprintf(stderr, "ERROR: %s\n", cyaml_strerror(err));
+		arena_free(arena);
 		return NULL;
 	}
 
+	p->arena = arena;
 	return p;
 }
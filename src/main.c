@@ -9,13 +9,52 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
+#include "batch.h"
 #include "output.h"
 #include "puzzle.h"
 #include "options.h"
+#include "tune.h"
+
+/** Exit status for a puzzle with more than one solution. */
+#define EXIT_MULTIPLE 2
+
+/** Exit status for a puzzle with no solution. */
+#define EXIT_NONE 3
+
+/**
+ * Report the number of solutions found by counting.
+ *
+ * \param[in]  options  The options.
+ * \param[in]  puzzle   The solved puzzle.
+ * \return the exit status for the count.
+ */
+static int main__count_report(
+		const struct options *options,
+		const struct puzzle *puzzle)
+{
+	size_t count = puzzle->solution_count;
+
+	if (count == 0) {
+		printf("No solutions.\n");
+		return EXIT_NONE;
+
+	} else if (count == 1) {
+		printf("Unique solution.\n");
+		return EXIT_SUCCESS;
+
+	} else if (count >= options->count_solutions) {
+		printf("At least %zu solutions.\n", count);
+	} else {
+		printf("%zu solutions.\n", count);
+	}
+
+	return EXIT_MULTIPLE;
+}
 
 int main(int argc, const char *argv[])
 {
 	const struct options *options;
+	struct output *output = NULL;
 	struct puzzle *puzzle;
 	int exit_code;
 
@@ -36,34 +75,52 @@ int main(int argc, const char *argv[])
 		printf("%s version %d.%d.%d\n", argv[0], major, minor, patch);
 		return EXIT_SUCCESS;
 
+	} else if (options->tune != NULL) {
+		return tune_run(options);
+
+	} else if (options->batch != NULL) {
+		return batch_run(options);
+
 	} else if (options->input == NULL) {
 		fprintf(stderr, "No input YAML puzzle file provided!\n");
 		options_print_usage(argv);
 		return EXIT_FAILURE;
 	}
 
-	puzzle = puzzle_create(options->input);
+	puzzle = puzzle_create(options, options->input);
 	if (puzzle == NULL) {
 		fprintf(stderr, "Failed to create puzzle!\n");
 		return EXIT_FAILURE;
 	}
 
-	if (!output_init(options, puzzle)) {
+	output = output_create(options, puzzle);
+	if (output == NULL) {
 		fprintf(stderr, "Failed to initialise output!\n");
 		exit_code = EXIT_FAILURE;
 		goto exit;
 	}
+	puzzle_set_event_fn(puzzle, output_event_cb, output);
 
 	if (!puzzle_solve(puzzle)) {
+		if (options->count_solutions > 0 &&
+		    puzzle->solution_count == 0) {
+			exit_code = main__count_report(options, puzzle);
+			goto exit;
+		}
 		fprintf(stderr, "Failed to solve puzzle!\n");
 		exit_code = EXIT_FAILURE;
 		goto exit;
 	}
 
+	if (options->count_solutions > 0 && puzzle->solution_count > 0) {
+		exit_code = main__count_report(options, puzzle);
+		goto exit;
+	}
+
 	exit_code = EXIT_SUCCESS;
 
 exit:
-	output_fini();
+	output_free(output);
 	puzzle_free(puzzle);
 	return exit_code;
 }
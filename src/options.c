@@ -9,16 +9,22 @@
 
 #include "cli.h"
 #include "output.h"
+#include "puzzle.h"
 #include "options.h"
 
-/** Default options, overwritten by CLI arguments. */
-static struct options options = {
+/** Default options. */
+static const struct options options_default = {
 	.delay = 20,
 	.grid_size = 16,
 	.border_width = 1,
 	.final_delay = 500,
+	.threads = 1,
 	.event = OUTPUT_EVENT_LINE,
 	.style = OUTPUT_STYLE_SIMPLE,
+	.encoder = OUTPUT_ENCODER_CGIF,
+	.line_solver = PUZZLE_LINE_SOLVER_OVERLAP,
+	.scheduler = PUZZLE_SCHEDULER_PASS,
+	.backend = PUZZLE_BACKEND_LINES,
 	.colour = {
 		.set = 0x000000,
 		.clear = 0xFFFFFF,
@@ -26,6 +32,9 @@ static struct options options = {
 	},
 };
 
+/** Options, set from the defaults and then overwritten by CLI arguments. */
+static struct options options;
+
 static struct cli_str_val cli_img_opt_style[] = {
 	{
 		.str = "simple",
@@ -64,6 +73,80 @@ static struct cli_str_val cli_img_opt_event[] = {
 	{ .str = NULL },
 };
 
+static struct cli_str_val cli_img_opt_encoder[] = {
+	{
+		.str = "cgif",
+		.val = OUTPUT_ENCODER_CGIF,
+		.d   = "Encode the GIF with libcgif.",
+	},
+	{
+		.str = "builtin",
+		.val = OUTPUT_ENCODER_BUILTIN,
+		.d   = "Encode the GIF with the built-in encoder. Each frame "
+		       "only holds the cells changed since the last frame, "
+		       "and frames are compressed on --threads threads.",
+	},
+	{ .str = NULL },
+};
+
+static struct cli_str_val cli_puzzle_opt_line_solver[] = {
+	{
+		.str = "enumerate",
+		.val = PUZZLE_LINE_SOLVER_ENUMERATE,
+		.d   = "Try every possible placement of the clues on a line. "
+		       "Slow for lines with many clues.",
+	},
+	{
+		.str = "overlap",
+		.val = PUZZLE_LINE_SOLVER_OVERLAP,
+		.d   = "Find where each clue can go from the left-most and "
+		       "right-most packing of the clues. Fixes the same cells "
+		       "and gives the same detail style output as enumerate.",
+	},
+	{
+		.str = "auto",
+		.val = PUZZLE_LINE_SOLVER_AUTO,
+		.d   = "Pick a line solver for each line. Lines with only one "
+		       "way left to place their clues are completed directly. "
+		       "Short lines with few clues use enumerate, and the "
+		       "rest use overlap. See --tune.",
+	},
+	{ .str = NULL },
+};
+
+static struct cli_str_val cli_puzzle_opt_scheduler[] = {
+	{
+		.str = "pass",
+		.val = PUZZLE_SCHEDULER_PASS,
+		.d   = "Alternate between passes over every row and passes "
+		       "over every column.",
+	},
+	{
+		.str = "queue",
+		.val = PUZZLE_SCHEDULER_QUEUE,
+		.d   = "Only solve lines crossing newly solved cells, taking "
+		       "lines with the most newly solved cells first.",
+	},
+	{ .str = NULL },
+};
+
+static struct cli_str_val cli_puzzle_opt_backend[] = {
+	{
+		.str = "lines",
+		.val = PUZZLE_BACKEND_LINES,
+		.d   = "Solve one line at a time, with probing and search "
+		       "if enabled.",
+	},
+	{
+		.str = "sat",
+		.val = PUZZLE_BACKEND_SAT,
+		.d   = "Encode the clues as a boolean formula, and solve it "
+		       "with the built-in clause-learning SAT solver. Prints "
+		       "the SAT solver's statistics.",
+	},
+	{ .str = NULL },
+};
+
 static const struct cli_table_entry cli_entries[] = {
 	{
 		.p = true,
@@ -72,6 +155,17 @@ static const struct cli_table_entry cli_entries[] = {
 		.v.s = &options.input,
 		.d = "Path to YAML input file.",
 	},
+	{
+		.l = "batch",
+		.t = CLI_STRING,
+		.no_pos = true,
+		.v.s = &options.batch,
+		.d = "Solve a batch of puzzles, instead of FILE. Either a "
+		     "directory, whose '.yaml' files are solved, or a file "
+		     "listing a puzzle file path on each line. In batch mode, "
+		     "'%n' in the output path is replaced by each puzzle's "
+		     "file name, without its extension, and '%%' by '%'.",
+	},
 	{
 		.s = 'b',
 		.l = "border-width",
@@ -122,7 +216,9 @@ static const struct cli_table_entry cli_entries[] = {
 		.l = "keep-frames",
 		.t = CLI_BOOL,
 		.v.b = &options.keep_frames,
-		.d = "Keep GIF frames with no changes.",
+		.d = "Keep GIF frames with no changes. Otherwise, they are "
+		     "merged into the frame before, and their delays added "
+		     "to its delay.",
 	},
 	{
 		.s = 'o',
@@ -153,6 +249,17 @@ static const struct cli_table_entry cli_entries[] = {
 		.v.e.desc = cli_img_opt_style,
 		.d = "Set the output GIF style to use.",
 	},
+	{
+		.s = 't',
+		.l = "threads",
+		.t = CLI_UINT,
+		.v.u = &options.threads,
+		.d = "Number of threads to solve the lines of each pass on. "
+		     "Only used by the pass scheduler. In batch mode, the "
+		     "number of puzzles to solve at once instead. Also the "
+		     "number of threads the built-in encoder compresses "
+		     "frames on.",
+	},
 	{
 		.s = 'v',
 		.l = "version",
@@ -161,6 +268,130 @@ static const struct cli_table_entry cli_entries[] = {
 		.v.b = &options.version,
 		.d = "Print version information.",
 	},
+	{
+		.l = "backend",
+		.t = CLI_ENUM,
+		.v.e.e = &options.backend,
+		.v.e.desc = cli_puzzle_opt_backend,
+		.d = "Set how the puzzle is solved.",
+	},
+	{
+		.l = "line-solver",
+		.t = CLI_ENUM,
+		.v.e.e = &options.line_solver,
+		.v.e.desc = cli_puzzle_opt_line_solver,
+		.d = "Set the algorithm used to solve each line.",
+	},
+	{
+		.l = "packed",
+		.t = CLI_BOOL,
+		.v.b = &options.packed,
+		.d = "Keep packed bitmasks of the known set and clear cells "
+		     "on each line, and use word-wide bit operations on them "
+		     "in the line solvers.",
+	},
+	{
+		.l = "scheduler",
+		.t = CLI_ENUM,
+		.v.e.e = &options.scheduler,
+		.v.e.desc = cli_puzzle_opt_scheduler,
+		.d = "Set how the solver picks which line to solve next.",
+	},
+	{
+		.l = "summary",
+		.t = CLI_STRING,
+		.v.s = &options.summary,
+		.d = "In batch mode, write a line of JSON for each puzzle to "
+		     "the given path, rather than to stdout. Each gives the "
+		     "puzzle's status, time taken, passes and cells solved.",
+	},
+	{
+		.l = "encoder",
+		.t = CLI_ENUM,
+		.v.e.e = &options.encoder,
+		.v.e.desc = cli_img_opt_encoder,
+		.d = "Set the GIF encoder to use.",
+	},
+	{
+		.l = "frame-queue",
+		.t = CLI_UINT,
+		.v.u = &options.frame_queue,
+		.d = "Draw and compress animation frames on their own thread, "
+		     "so the solver doesn't wait for them, with up to the "
+		     "given number of frames waiting to be encoded. The "
+		     "solver waits when the queue is full, which bounds the "
+		     "memory used. Off when 0.",
+	},
+	{
+		.l = "frame-threshold",
+		.t = CLI_UINT,
+		.v.u = &options.frame_threshold,
+		.d = "Also merge frames that look almost the same as the "
+		     "frame before, where no cell's shade has moved more "
+		     "than the given number of palette steps since that "
+		     "frame. Mostly for the detail style. 0 merges only "
+		     "frames with no changes.",
+	},
+	{
+		.l = "line-cache",
+		.t = CLI_UINT,
+		.v.u = &options.line_cache,
+		.d = "Keep the results of line solves, up to the given number "
+		     "of KiB, and reuse them for lines with the same clues "
+		     "and solved slots. Statistics are printed at the end. "
+		     "Off when 0.",
+	},
+	{
+		.l = "line-dedupe",
+		.t = CLI_BOOL,
+		.v.b = &options.line_dedupe,
+		.d = "Solve lines of a pass that have the same clues and "
+		     "solved slots once, and give the result to each of them. "
+		     "Only used by the pass scheduler. Statistics are printed "
+		     "at the end.",
+	},
+	{
+		.l = "tune",
+		.t = CLI_STRING,
+		.no_pos = true,
+		.v.s = &options.tune,
+		.d = "Time the line solvers on this machine, with the other "
+		     "options given, and write the line lengths that the auto "
+		     "line solver should use enumerate for to the given "
+		     "tuning file, instead of solving a puzzle.",
+	},
+	{
+		.l = "tuning",
+		.t = CLI_STRING,
+		.v.s = &options.tuning,
+		.d = "Read the tuning for the auto line solver from the given "
+		     "file, as written by --tune. Without it, built-in "
+		     "tuning is used.",
+	},
+	{
+		.l = "probe",
+		.t = CLI_BOOL,
+		.v.b = &options.probe,
+		.d = "When line solving stops making progress, try each "
+		     "unsolved cell as set and as clear, and keep what "
+		     "follows from both, or from the only one that works.",
+	},
+	{
+		.l = "search",
+		.t = CLI_BOOL,
+		.v.b = &options.search,
+		.d = "When line solving stops making progress, guess cells "
+		     "and backtrack from guesses that lead to contradictions.",
+	},
+	{
+		.l = "count-solutions",
+		.t = CLI_UINT,
+		.v.u = &options.count_solutions,
+		.d = "Count the puzzle's solutions, stopping once the given "
+		     "number have been found. The exit status is 0 for a "
+		     "unique solution, 2 for more than one, and 3 for none. "
+		     "Limits below 2 are raised to 2.",
+	},
 	{
 		.l = "colour-set",
 		.t = CLI_UINT,
@@ -192,8 +423,14 @@ const struct cli_table cli = {
 	     "solutions.",
 };
 
+void options_init(struct options *opt)
+{
+	*opt = options_default;
+}
+
 const struct options *options_parse(int argc, const char *argv[])
 {
+	options_init(&options);
 
 	if (!cli_parse(&cli, argc, (void *)argv)) {
 		cli_help(&cli, argv[0]);
@@ -19,12 +19,24 @@ struct options {
 	bool version;
 	bool progress;
 	bool keep_frames;
+	bool packed;
+	bool probe;
+	bool search;
+	bool line_dedupe;
 
 	const char *input;
 	const char *output;
+	const char *batch;
+	const char *summary;
+	const char *tune;
+	const char *tuning;
 
 	int64_t event;
 	int64_t style;
+	int64_t encoder;
+	int64_t line_solver;
+	int64_t scheduler;
+	int64_t backend;
 
 	uint64_t delay;
 	uint64_t final_delay;
@@ -32,9 +44,18 @@ struct options {
 	uint64_t grid_size;
 	uint64_t border_width;
 
+	uint64_t threads;
+	uint64_t line_cache;
+	uint64_t frame_queue;
+	uint64_t frame_threshold;
+
+	uint64_t count_solutions;
+
 	struct options_colour colour;
 };
 
+void options_init(struct options *opt);
+
 const struct options *options_parse(int argc, const char *argv[]);
 
 void options_print_usage(const char *argv[]);
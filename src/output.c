@@ -4,44 +4,98 @@
  * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
  */
 
+#include <stdint.h>
 #include <inttypes.h>
 #include <stdbool.h>
-#include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <threads.h>
 
 #include <cgif.h>
 
 #include "options.h"
 #include "output.h"
 #include "puzzle.h"
+#include "gif.h"
 #include "grid.h"
-
-static struct {
+#include "ring.h"
+
+/** Number of steps in the detail style's placement ratio table. */
+#define OUTPUT__RATIO_STEPS 4096
+
+/** The cells a frame of animation changes. */
+struct output__frame {
+	uint32_t *cell; /**< Index of each cell to redraw, unless all are. */
+	uint8_t *level; /**< Palette index of each cell to redraw. */
+	size_t count;   /**< Number of cells to redraw. */
+	size_t cap;     /**< Allocated entries in cell. */
+	bool all;       /**< Whether every cell is redrawn, in row order. */
+	uint16_t delay; /**< Frame delay (cs). */
+};
+
+/** Rendering state for a puzzle's output. */
+struct output {
 	const struct options *options;
 	const struct puzzle *puzzle;
 	struct grid *grid;
+	uint8_t *level; /**< Palette index of each cell, in row order. */
+
+	CGIF *cgif;      /**< The GIF, when encoded by cgif. */
+	struct gif *gif; /**< The GIF, when encoded by the built-in encoder. */
 
-	size_t cells_complete;
+	struct output__frame next; /**< Frame of the latest changes. */
+	struct output__frame held; /**< Last frame, not yet encoded. */
+	bool have_held;            /**< Whether there is a held frame. */
+	/** Palette index of each cell, as the held frame first showed it. */
+	uint8_t *shown;
 
-	CGIF *gif;
+	/** Frames queued for the encoder thread. */
+	struct output__frame *frame;
+	size_t frame_count;
+
+	struct ring *ring;  /**< Frames queued for the encoder, or NULL. */
+	thrd_t encoder;     /**< Thread drawing and compressing frames. */
+	atomic_bool failed; /**< Whether the encoder thread has failed. */
 
 	uint8_t palette[3 * 256];
 	uint16_t palette_count;
 	size_t border_index;
 	size_t set_index;
-} output_g;
 
-static bool output__add_frame(void)
+	/** Detail style: Palette index for each placement ratio step. */
+	uint8_t ratio_level[OUTPUT__RATIO_STEPS + 1];
+};
+
+/**
+ * Add the grid to the GIF as a frame.
+ *
+ * \param[in]  o      The output.
+ * \param[in]  delay  Frame delay (cs).
+ * \param[in]  rect   The part of the grid changed since the last frame.
+ *                    Only used by the built-in encoder; cgif finds it.
+ * \return true on success, or false on error.
+ */
+static bool output__add_frame(
+		struct output *o,
+		uint16_t delay,
+		const struct gif_rect *rect)
 {
-	uint64_t delay = (puzzle_is_complete(output_g.puzzle)) ?
-			output_g.options->final_delay : output_g.options->delay;
 	CGIF_FrameConfig config = {
-		.delay = (uint16_t)delay,
-		.pImageData = output_g.grid->data,
+		.delay = delay,
+		.pImageData = o->grid->data,
 		.genFlags = CGIF_FRAME_GEN_USE_DIFF_WINDOW,
 	};
 
-	if (cgif_addframe(output_g.gif, &config) != CGIF_OK) {
+	if (o->gif != NULL) {
+		if (!gif_add_frame(o->gif, o->grid->data, rect, delay)) {
+			fprintf(stderr, "Error adding GIF frame\n");
+			return false;
+		}
+		return true;
+	}
+
+	if (cgif_addframe(o->cgif, &config) != CGIF_OK) {
 		fprintf(stderr, "Error adding GIF frame\n");
 		return false;
 	}
@@ -50,6 +104,7 @@ static bool output__add_frame(void)
 }
 
 static bool output__create(
+		struct output *o,
 		const struct options *opt,
 		uint16_t width,
 		uint16_t height)
@@ -60,130 +115,498 @@ static bool output__create(
 		attr_flags |= CGIF_ATTR_IS_ANIMATED;
 	}
 
-	output_g.gif = cgif_newgif(&(CGIF_Config) {
-		.numLoops = 1,
-		.width = width,
-		.height = height,
-		.path = opt->output,
-		.attrFlags = attr_flags,
-		.pGlobalPalette = output_g.palette,
-		.numGlobalPaletteEntries = output_g.palette_count,
-	});
-	if (output_g.gif == NULL) {
+	if (opt->encoder == OUTPUT_ENCODER_BUILTIN) {
+		o->gif = gif_create(&(struct gif_config) {
+			.path = opt->output,
+			.palette = o->palette,
+			.palette_count = o->palette_count,
+			.width = width,
+			.height = height,
+			.loops = 1,
+			.animated = opt->event != OUTPUT_EVENT_FINAL,
+			.threads = (size_t)opt->threads,
+		});
+	} else {
+		o->cgif = cgif_newgif(&(CGIF_Config) {
+			.numLoops = 1,
+			.width = width,
+			.height = height,
+			.path = opt->output,
+			.attrFlags = attr_flags,
+			.pGlobalPalette = o->palette,
+			.numGlobalPaletteEntries = o->palette_count,
+		});
+	}
+	if (o->gif == NULL && o->cgif == NULL) {
 		fprintf(stderr, "Failed to create output GIF file.\n");
 		return false;
 	}
 
-	if (opt->event != OUTPUT_EVENT_FINAL) {
-		if (!output__add_frame()) {
-			return false;
+	return true;
+}
+
+static uint8_t output__get_level(
+		const struct output *o,
+		size_t x,
+		size_t y)
+{
+	const struct puzzle *p = o->puzzle;
+	const struct options *opt = o->options;
+	enum puzzle_cell state = puzzle_line_get(&p->row[y], x);
+	uint8_t level_set = (uint8_t)o->set_index;
+	double ratio;
+
+	if (state == PUZZLE_CELL_CLEAR) {
+		return 0;
+	} else if (state == PUZZLE_CELL_SET) {
+		return level_set;
+	} else if (opt->style == OUTPUT_STYLE_SIMPLE) {
+		return level_set / 2;
+	} else if (p->col[x].slot_max == 0 || p->row[y].slot_max == 0) {
+		/* A line solve that failed leaves no placements to count. */
+		return level_set / 2;
+	}
+
+	ratio = ((double)p->col[x].count[y] / (double)p->col[x].slot_max +
+	         (double)p->row[y].count[x] / (double)p->row[y].slot_max) / 2;
+	if (ratio > 1) {
+		ratio = 1;
+	}
+
+	return o->ratio_level[(size_t)(ratio * OUTPUT__RATIO_STEPS + 0.5)];
+}
+
+/**
+ * Set up the detail style's placement ratio to palette index table.
+ *
+ * A cell's level is the set level scaled by the ratio, rounded up, so only
+ * cells that can't be set are drawn clear.
+ */
+static void output__ratio_level_init(struct output *o)
+{
+	size_t max_idx = o->set_index;
+
+	for (size_t i = 0; i <= OUTPUT__RATIO_STEPS; i++) {
+		o->ratio_level[i] = (uint8_t)(max_idx -
+				(OUTPUT__RATIO_STEPS - i) * max_idx /
+				OUTPUT__RATIO_STEPS);
+	}
+}
+
+/**
+ * Draw a cell, inside its border.
+ */
+static void output__cell_draw(
+		struct output *o,
+		size_t x,
+		size_t y,
+		uint8_t level)
+{
+	const struct options *opt = o->options;
+	const struct grid *g = o->grid;
+	size_t inner = opt->grid_size - opt->border_width;
+	uint8_t *row;
+
+	row = &g->data[(y * opt->grid_size + opt->border_width) * g->width +
+			x * opt->grid_size + opt->border_width];
+	for (size_t i = opt->border_width; i < opt->grid_size; i++) {
+		memset(row, level, inner);
+		row += g->width;
+	}
+}
+
+/**
+ * Redraw the whole grid from the cell levels.
+ *
+ * The first pixel row inside the border of each row of cells is drawn a
+ * cell at a time, and then copied to the rest of the row's pixel rows.
+ *
+ * \param[in]  o       The output.
+ * \param[in]  levels  Palette index of each cell, in row order.
+ */
+static void output__grid_draw(struct output *o, const uint8_t *levels)
+{
+	const struct options *opt = o->options;
+	const struct grid *g = o->grid;
+	size_t w = o->puzzle->col_count;
+	size_t h = o->puzzle->row_count;
+	size_t size = opt->grid_size;
+	size_t border = opt->border_width;
+	uint8_t level_border = (uint8_t)o->border_index;
+
+	if (border >= size) {
+		memset(g->data, level_border, g->width * g->height);
+		return;
+	}
+
+	for (size_t y = 0; y < h; y++) {
+		uint8_t *top = &g->data[y * size * g->width];
+		uint8_t *row = top + border * g->width;
+		const uint8_t *level = &levels[y * w];
+
+		memset(top, level_border, border * g->width);
+
+		for (size_t x = 0; x < w; x++) {
+			memset(row + x * size, level_border, border);
+			memset(row + x * size + border, level[x], size - border);
 		}
+		memset(row + w * size, level_border, g->width - w * size);
+
+		for (size_t i = border + 1; i < size; i++) {
+			memcpy(row + (i - border) * g->width, row, g->width);
+		}
+	}
+
+	memset(&g->data[h * size * g->width], level_border,
+			(g->height - h * size) * g->width);
+}
+
+/**
+ * Make sure a frame has room for a number of cells to redraw.
+ */
+static bool output__frame_reserve(struct output__frame *f, size_t count)
+{
+	uint32_t *cell;
+
+	if (count <= f->cap) {
+		return true;
 	}
 
+	cell = realloc(f->cell, count * sizeof(*cell));
+	if (cell == NULL) {
+		fprintf(stderr, "Error: Failed to allocate frame!\n");
+		return false;
+	}
+
+	f->cell = cell;
+	f->cap = count;
 	return true;
 }
 
-static uint8_t output__get_level(size_t x, size_t y)
+/**
+ * Record the cells the puzzle has changed since the last frame.
+ *
+ * Only the cells the puzzle has changed are looked at, unless it has lost
+ * track of them, and only the ones whose level has changed are recorded.
+ *
+ * \param[in]  o  The output.
+ * \param[in]  f  The frame to record the changes in.
+ * 
+eturn true on success, or false on error.
+ */
+static bool output__frame_make(struct output *o, struct output__frame *f)
 {
-	const struct puzzle *p = output_g.puzzle;
-	const struct options *opt = output_g.options;
-	struct puzzle_slot *slot_col = &p->col[x].slot[y];
-	struct puzzle_slot *slot_row = &p->row[y].slot[x];
-	uint8_t level_set = (uint8_t)output_g.set_index;
-	uint8_t level;
-
-	assert(slot_col->done == slot_row->done);
-
-	if (slot_col->done) {
-		if (slot_col->value == 0) {
-			level = 0;
-		} else {
-			level = level_set;
+	const struct puzzle *p = o->puzzle;
+	struct puzzle_changes *ch = p->changes;
+	size_t w = p->col_count;
+	size_t h = p->row_count;
+
+	f->count = 0;
+	f->all = ch == NULL || ch->all ||
+			o->options->border_width >= o->options->grid_size;
+	f->delay = (uint16_t)((puzzle_is_complete(p)) ?
+			o->options->final_delay : o->options->delay);
+
+	if (f->all) {
+		for (size_t y = 0; y < h; y++) {
+			for (size_t x = 0; x < w; x++) {
+				o->level[y * w + x] =
+						output__get_level(o, x, y);
+			}
 		}
-	} else if (opt->style == OUTPUT_STYLE_SIMPLE) {
-		level = level_set / 2;
+		memcpy(f->level, o->level, w * h);
+		f->count = w * h;
+
 	} else {
-		size_t slot_val = slot_col->value * p->row[y].slot_max +
-		                  slot_row->value * p->col[x].slot_max;
-		size_t slot_max = p->col[x].slot_max *
-		                  p->row[y].slot_max * 2ll;
-		size_t max_idx = level_set;
+		if (!output__frame_reserve(f, ch->count)) {
+			return false;
+		}
 
-		assert(slot_val <= slot_max);
+		for (size_t i = 0; i < ch->count; i++) {
+			size_t cell = ch->cell[i];
+			uint8_t level = output__get_level(o,
+					cell % w, cell / w);
 
-		slot_val = slot_max - slot_val;
-		level = (uint8_t)(max_idx -
-				(slot_val * max_idx /
-				slot_max));
+			if (o->level[cell] != level) {
+				o->level[cell] = level;
+				f->cell[f->count] = (uint32_t)cell;
+				f->level[f->count] = level;
+				f->count++;
+			}
+		}
 	}
 
-	return level;
+	if (ch != NULL) {
+		puzzle_changes_clear(ch);
+	}
+	return true;
 }
 
-static void output__grid_update(void)
+/**
+ * Draw a frame's changes to the grid.
+ *
+ * \param[in]  o     The output.
+ * \param[in]  f     The frame to draw.
+ * \param[out] rect  Returns the part of the grid that was drawn. When
+ *                   nothing was, a single pixel.
+ */
+static void output__frame_draw(
+		struct output *o,
+		const struct output__frame *f,
+		struct gif_rect *rect)
 {
-	const struct options *opt = output_g.options;
-	const struct puzzle *p = output_g.puzzle;
-	const struct grid *g = output_g.grid;
-	size_t w = p->col_count;
-	size_t h = p->row_count;
-	uint8_t level_border;
+	const struct options *opt = o->options;
+	size_t w = o->puzzle->col_count;
+	size_t x0 = SIZE_MAX;
+	size_t y0 = SIZE_MAX;
+	size_t x1 = 0;
+	size_t y1 = 0;
+
+	if (f->all) {
+		output__grid_draw(o, f->level);
+		*rect = (struct gif_rect) {
+			.w = (uint16_t)o->grid->width,
+			.h = (uint16_t)o->grid->height,
+		};
+		return;
+	}
 
-	level_border = (uint8_t)output_g.border_index;
+	for (size_t i = 0; i < f->count; i++) {
+		size_t x = f->cell[i] % w;
+		size_t y = f->cell[i] / w;
 
-	for (size_t y = 0; y < h; y++) {
-		for (size_t x = 0; x < w; x++) {
-			uint8_t level = output__get_level(x, y);
-
-			for (size_t i = 0; i < opt->grid_size; i++) {
-				size_t yy = y * opt->grid_size + i;
-				bool border_y = i < opt->border_width;
-				for (size_t j = 0; j < opt->grid_size; j++) {
-					size_t xx = x * opt->grid_size + j;
-					bool border_x = j < opt->border_width;
-					size_t pos = yy * g->width + xx;
-
-					if (border_x || border_y) {
-						g->data[pos] = level_border;
-					} else {
-						g->data[pos] = level;
-					}
-				}
+		output__cell_draw(o, x, y, f->level[i]);
+
+		x0 = (x < x0) ? x : x0;
+		y0 = (y < y0) ? y : y0;
+		x1 = (x > x1) ? x : x1;
+		y1 = (y > y1) ? y : y1;
+	}
+
+	if (f->count == 0) {
+		*rect = (struct gif_rect) { .w = 1, .h = 1 };
+		return;
+	}
+
+	*rect = (struct gif_rect) {
+		.x = (uint16_t)(x0 * opt->grid_size + opt->border_width),
+		.y = (uint16_t)(y0 * opt->grid_size + opt->border_width),
+		.w = (uint16_t)((x1 - x0 + 1) * opt->grid_size -
+				opt->border_width),
+		.h = (uint16_t)((y1 - y0 + 1) * opt->grid_size -
+				opt->border_width),
+	};
+}
+
+/**
+ * Encoder thread: draw and compress queued frames until the ring closes.
+ *
+ * After an error, frames are still taken, so the solver never waits on a
+ * full ring.
+ */
+static int output__encoder(void *arg)
+{
+	struct output *o = arg;
+	size_t slot;
+
+	while (ring_pop_slot(o->ring, &slot)) {
+		const struct output__frame *f = &o->frame[slot];
+
+		if (!atomic_load(&o->failed)) {
+			struct gif_rect rect;
+
+			output__frame_draw(o, f, &rect);
+			if (!output__add_frame(o, f->delay, &rect)) {
+				atomic_store(&o->failed, true);
 			}
 		}
+		ring_pop(o->ring);
+	}
+
+	return 0;
+}
+
+/**
+ * Encode a frame, or queue it for the encoder thread.
+ *
+ * A queued frame's contents are swapped with a free queue entry's.
+ *
+ * \param[in]  o  The output.
+ * \param[in]  f  The frame to encode.
+ * \return true on success, or false on error.
+ */
+static bool output__frame_emit(struct output *o, struct output__frame *f)
+{
+	struct output__frame *slot;
+	struct output__frame swap;
+
+	if (o->ring == NULL) {
+		struct gif_rect rect;
+
+		output__frame_draw(o, f, &rect);
+		return output__add_frame(o, f->delay, &rect);
+	}
+
+	if (atomic_load(&o->failed)) {
+		return false;
+	}
+
+	slot = &o->frame[ring_push_slot(o->ring)];
+	swap = *slot;
+	*slot = *f;
+	*f = swap;
+	ring_push(o->ring);
+	return true;
+}
+
+/**
+ * Check whether the latest changes look enough like the held frame to be
+ * merged into it.
+ *
+ * They do if no cell's level is further than the frame threshold from how
+ * the held frame first showed it, so merged frames can't drift away from
+ * it bit by bit.
+ */
+static bool output__frame_similar(const struct output *o)
+{
+	const struct output__frame *f = &o->next;
+	size_t threshold = (size_t)o->options->frame_threshold;
+
+	if (o->options->keep_frames ||
+	    (size_t)o->held.delay + f->delay > UINT16_MAX) {
+		return false;
 	}
 
-	for (size_t y = 0; y < g->height; y++) {
-		for (size_t x = w * opt->grid_size; x < g->width; x++) {
-			size_t pos = y * g->width + x;
-			g->data[pos] = level_border;
+	if (o->options->border_width >= o->options->grid_size) {
+		/* Every frame is all border. */
+		return true;
+	}
+
+	for (size_t i = 0; i < f->count; i++) {
+		size_t cell = (f->all) ? i : f->cell[i];
+		int diff = f->level[i] - o->shown[cell];
+
+		if ((size_t)abs(diff) > threshold) {
+			return false;
 		}
 	}
 
-	for (size_t y = h * opt->grid_size; y < g->height; y++) {
-		for (size_t x = 0; x < g->width; x++) {
-			size_t pos = y * g->width + x;
-			g->data[pos] = level_border;
+	return true;
+}
+
+/**
+ * Merge the latest changes into the held frame, adding up their delays.
+ */
+static bool output__frame_merge(struct output *o)
+{
+	struct output__frame *held = &o->held;
+	struct output__frame *f = &o->next;
+	uint16_t delay = (uint16_t)(held->delay + f->delay);
+
+	if (f->all) {
+		struct output__frame swap = *held;
+
+		*held = *f;
+		*f = swap;
+
+	} else if (held->all) {
+		for (size_t i = 0; i < f->count; i++) {
+			held->level[f->cell[i]] = f->level[i];
+		}
+
+	} else if (f->count > 0) {
+		if (!output__frame_reserve(held, held->count + f->count)) {
+			return false;
 		}
+		memcpy(held->cell + held->count, f->cell,
+				f->count * sizeof(*f->cell));
+		memcpy(held->level + held->count, f->level, f->count);
+		held->count += f->count;
+	}
+
+	held->delay = delay;
+	return true;
+}
+
+/**
+ * Bring the shown levels of a frame's cells up to date.
+ */
+static void output__shown_update(
+		struct output *o,
+		const struct output__frame *f)
+{
+	if (f->all) {
+		memcpy(o->shown, o->level, f->count);
+		return;
 	}
 
-	output_g.cells_complete = p->cells_complete;
+	for (size_t i = 0; i < f->count; i++) {
+		o->shown[f->cell[i]] = o->level[f->cell[i]];
+	}
 }
 
-static void output__generate_palette_spectrum(int count)
+/**
+ * Encode the held frame, and hold the latest changes in its place.
+ */
+static bool output__frame_hold(struct output *o)
+{
+	struct output__frame swap;
+	bool ok = true;
+
+	if (o->have_held) {
+		output__shown_update(o, &o->held);
+		ok = output__frame_emit(o, &o->held);
+	}
+	output__shown_update(o, &o->next);
+
+	swap = o->held;
+	o->held = o->next;
+	o->next = swap;
+	o->have_held = true;
+
+	return ok;
+}
+
+/**
+ * Add a frame of the puzzle's current state to the animation.
+ *
+ * Each frame is held back until the next, so that later frames that look
+ * the same can be merged into it, rather than added as frames of their own.
+ * Frames of output that isn't animated are encoded straight away.
+ */
+static bool output__frame_add(struct output *o)
+{
+	if (!output__frame_make(o, &o->next)) {
+		return false;
+	}
+
+	if (o->options->event == OUTPUT_EVENT_FINAL) {
+		return output__frame_emit(o, &o->next);
+	}
+
+	if (o->have_held && output__frame_similar(o)) {
+		return output__frame_merge(o);
+	}
+
+	return output__frame_hold(o);
+}
+
+static void output__generate_palette_spectrum(
+		struct output *o,
+		int count)
 {
 	enum { RED, GREEN, BLUE, COUNT };
 	int set[COUNT] = {
-		[RED  ] = (output_g.options->colour.set >> 16) & 0xFF,
-		[GREEN] = (output_g.options->colour.set >>  8) & 0xFF,
-		[BLUE ] = (output_g.options->colour.set >>  0) & 0xFF,
+		[RED  ] = (o->options->colour.set >> 16) & 0xFF,
+		[GREEN] = (o->options->colour.set >>  8) & 0xFF,
+		[BLUE ] = (o->options->colour.set >>  0) & 0xFF,
 	};
 	int clear[COUNT] = {
-		[RED  ] = (output_g.options->colour.clear >> 16) & 0xFF,
-		[GREEN] = (output_g.options->colour.clear >>  8) & 0xFF,
-		[BLUE ] = (output_g.options->colour.clear >>  0) & 0xFF,
+		[RED  ] = (o->options->colour.clear >> 16) & 0xFF,
+		[GREEN] = (o->options->colour.clear >>  8) & 0xFF,
+		[BLUE ] = (o->options->colour.clear >>  0) & 0xFF,
 	};
-	uint8_t *p = output_g.palette;
+	uint8_t *p = o->palette;
 
 	for (int i = 0; i < count; i++) {
 		for (size_t c = 0; c < COUNT; c++) {
@@ -192,64 +615,128 @@ static void output__generate_palette_spectrum(int count)
 		}
 	}
 
-	output_g.set_index = (size_t)(count - 1);
+	o->set_index = (size_t)(count - 1);
 }
 
-static void output__generate_palette(void)
+static void output__generate_palette(struct output *o)
 {
 	enum { RED, GREEN, BLUE, COUNT };
 	int border[COUNT] = {
-		[RED  ] = (output_g.options->colour.border >> 16) & 0xFF,
-		[GREEN] = (output_g.options->colour.border >>  8) & 0xFF,
-		[BLUE ] = (output_g.options->colour.border >>  0) & 0xFF,
+		[RED  ] = (o->options->colour.border >> 16) & 0xFF,
+		[GREEN] = (o->options->colour.border >>  8) & 0xFF,
+		[BLUE ] = (o->options->colour.border >>  0) & 0xFF,
 	};
 
-	output_g.palette_count = 3;
+	o->palette_count = 3;
 
-	if (output_g.options->style == OUTPUT_STYLE_DETAILS) {
-		output_g.palette_count = 256;
+	if (o->options->style == OUTPUT_STYLE_DETAILS) {
+		o->palette_count = 256;
 	}
 
-	output__generate_palette_spectrum((int)output_g.palette_count);
+	output__generate_palette_spectrum(o, (int)o->palette_count);
 
-	if (output_g.options->border_width != 0) {
+	if (o->options->border_width != 0) {
 		bool have_border_colour = false;
 
-		for (int i = 0; i < output_g.palette_count; i++) {
-			uint8_t *p = &output_g.palette[i * 3];
+		for (int i = 0; i < o->palette_count; i++) {
+			uint8_t *p = &o->palette[i * 3];
 
 			if (border[RED  ] == p[RED  ] &&
 			    border[GREEN] == p[GREEN] &&
 			    border[BLUE ] == p[BLUE ]) {
 				have_border_colour = true;
-				output_g.border_index = (size_t)i;
+				o->border_index = (size_t)i;
 			}
 		}
 
 		if (have_border_colour == false) {
 			uint8_t *p;
 
-			if (output_g.palette_count == 256) {
-				output_g.palette_count--;
-				output__generate_palette_spectrum(
-						(int)output_g.palette_count);
+			if (o->palette_count == 256) {
+				o->palette_count--;
+				output__generate_palette_spectrum(o,
+						(int)o->palette_count);
 			}
 
-			output_g.border_index = output_g.palette_count;
-			p = &output_g.palette[output_g.border_index * 3];
+			o->border_index = o->palette_count;
+			p = &o->palette[o->border_index * 3];
 
 			p[RED  ] = (uint8_t)border[RED  ];
 			p[GREEN] = (uint8_t)border[GREEN];
 			p[BLUE ] = (uint8_t)border[BLUE ];
 
-			output_g.palette_count++;
+			o->palette_count++;
 		}
 	}
 }
 
-bool output_init(const struct options *opt,
+/**
+ * Allocate the frames, with one for each place in the encoder's queue.
+ */
+static bool output__frames_create(struct output *o)
+{
+	const struct options *opt = o->options;
+	size_t cells = o->puzzle->row_count * o->puzzle->col_count;
+
+	o->next.level = calloc(cells, sizeof(*o->next.level));
+	o->held.level = calloc(cells, sizeof(*o->held.level));
+	o->shown = calloc(cells, sizeof(*o->shown));
+	if (o->next.level == NULL || o->held.level == NULL ||
+	    o->shown == NULL) {
+		return false;
+	}
+
+	if (opt->frame_queue == 0 || opt->output == NULL ||
+	    opt->event == OUTPUT_EVENT_FINAL) {
+		return true;
+	}
+
+	o->frame = calloc(opt->frame_queue, sizeof(*o->frame));
+	if (o->frame == NULL) {
+		return false;
+	}
+	o->frame_count = opt->frame_queue;
+
+	for (size_t i = 0; i < o->frame_count; i++) {
+		o->frame[i].level = calloc(cells, sizeof(*o->frame[i].level));
+		if (o->frame[i].level == NULL) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Start the encoder thread, if the animation's frames are to be queued.
+ */
+static bool output__encoder_start(struct output *o)
+{
+	if (o->options->frame_queue == 0 ||
+	    o->options->event == OUTPUT_EVENT_FINAL) {
+		return true;
+	}
+
+	o->ring = ring_create(o->frame_count);
+	if (o->ring == NULL) {
+		return false;
+	}
+
+	if (thrd_create(&o->encoder, output__encoder, o) != thrd_success) {
+		fprintf(stderr, "Error: Failed to create thread!\n");
+		ring_free(o->ring);
+		o->ring = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+struct output *output_create(const struct options *opt,
 		const struct puzzle *puzzle)
 {
+	struct gif_rect rect;
+	struct output *o;
 	uint16_t height;
 	uint16_t width;
 	size_t size;
@@ -268,81 +755,144 @@ bool output_init(const struct options *opt,
 	}
 	height = (uint16_t) size;
 
-	output_g.options = opt;
-	output_g.puzzle = puzzle;
-	output__generate_palette();
+	o = calloc(1, sizeof(*o));
+	if (o == NULL) {
+		return NULL;
+	}
 
-	output_g.grid = grid_create(width, height);
-	if (output_g.grid == NULL) {
-		return false;
+	o->options = opt;
+	o->puzzle = puzzle;
+	atomic_init(&o->failed, false);
+	output__generate_palette(o);
+	output__ratio_level_init(o);
+
+	o->level = calloc(puzzle->row_count * puzzle->col_count,
+			sizeof(*o->level));
+	o->grid = grid_create(width, height);
+	if (o->level == NULL || o->grid == NULL ||
+	    !output__frames_create(o)) {
+		output_free(o);
+		return NULL;
 	}
 
-	output__grid_update();
+	if (!output__frame_make(o, &o->next)) {
+		output_free(o);
+		return NULL;
+	}
+	output__frame_draw(o, &o->next, &rect);
 
 	if (opt->output == NULL) {
-		return true;
+		return o;
 	}
 
-	if (!output__create(opt, width, height)) {
-		grid_free(output_g.grid);
-		return false;
+	if (!output__create(o, opt, width, height) ||
+	    !output__encoder_start(o)) {
+		output_free(o);
+		return NULL;
 	}
 
-	return true;
+	if (opt->event != OUTPUT_EVENT_FINAL) {
+		output__frame_hold(o);
+	}
+
+	return o;
+}
+
+/**
+ * Check whether an event should add a frame to the animation.
+ *
+ * Search guesses are shown in every animated output.
+ */
+static bool output__event_wanted(
+		const struct output *o,
+		enum output_event event)
+{
+	if (event == OUTPUT_EVENT_GUESS) {
+		return o->options->event != OUTPUT_EVENT_FINAL;
+	}
+
+	return event == o->options->event;
 }
 
-bool output_event_notify(enum output_event event)
+bool output_event_notify(struct output *o, enum output_event event)
 {
-	const struct puzzle *p = output_g.puzzle;
+	const struct puzzle *p = o->puzzle;
 
-	if (event == OUTPUT_EVENT_PASS && output_g.options->progress) {
+	if (event == OUTPUT_EVENT_PASS && o->options->progress) {
 		fprintf(stderr, "Solved %zu of %zu cells\n", p->cells_complete,
 				p->col_count * p->row_count);
 	}
 
-	if (output_g.options->keep_frames == false &&
-	    output_g.options->style == OUTPUT_STYLE_SIMPLE &&
-	    event != OUTPUT_EVENT_FINAL) {
-		if (output_g.cells_complete == p->cells_complete) {
-			return true;
-		}
-	}
-
-	if (output_g.options->quiet == false &&
+	if (o->options->quiet == false &&
 	    event == OUTPUT_EVENT_FINAL) {
 		for (size_t r = 0; r < p->row_count; r++) {
 			for (size_t s = 0; s < p->row[r].slot_count; s++) {
-				if (p->row[r].slot[s].done) {
-					if (p->row[r].slot[s].value == 0) {
-						printf("  ");
-					} else {
-						printf("##");
-					}
-				} else {
+				switch (puzzle_line_get(&p->row[r], s)) {
+				case PUZZLE_CELL_CLEAR:
+					printf("  ");
+					break;
+				case PUZZLE_CELL_SET:
+					printf("##");
+					break;
+				default:
 					printf("><");
+					break;
 				}
 			}
 			printf("\n");
 		}
 	}
 
-	if (event != output_g.options->event) {
+	if (!output__event_wanted(o, event)) {
 		return true;
 	}
 
-	if (output_g.grid != NULL && output_g.gif != NULL) {
-		output__grid_update();
-		return output__add_frame();
+	if (o->grid != NULL && (o->gif != NULL || o->cgif != NULL)) {
+		return output__frame_add(o);
 	}
 
 	return true;
 }
 
-void output_fini(void)
+bool output_event_cb(void *pw, enum output_event event)
+{
+	return output_event_notify(pw, event);
+}
+
+void output_free(struct output *o)
 {
-	grid_free(output_g.grid);
+	if (o == NULL) {
+		return;
+	}
+
+	if (o->have_held) {
+		output__frame_emit(o, &o->held);
+	}
 
-	if (output_g.gif != NULL) {
-		cgif_close(output_g.gif);
+	if (o->ring != NULL) {
+		ring_close(o->ring);
+		thrd_join(o->encoder, NULL);
+		ring_free(o->ring);
 	}
+
+	for (size_t i = 0; i < o->frame_count; i++) {
+		free(o->frame[i].cell);
+		free(o->frame[i].level);
+	}
+	free(o->frame);
+	free(o->next.cell);
+	free(o->next.level);
+	free(o->held.cell);
+	free(o->held.level);
+	free(o->shown);
+
+	grid_free(o->grid);
+	free(o->level);
+
+	if (o->cgif != NULL) {
+		cgif_close(o->cgif);
+	}
+	gif_close(o->gif);
+
+	free(o);
 }
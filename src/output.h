@@ -7,6 +7,7 @@
 #ifndef OUTPUT_H
 #define OUTPUT_H
 
+struct output;
 struct options;
 struct puzzle;
 
@@ -14,6 +15,7 @@ enum output_event {
 	OUTPUT_EVENT_LINE,  // One frame for every line.
 	OUTPUT_EVENT_PASS,  // One frame for each pass of the puzzle.
 	OUTPUT_EVENT_FINAL, // No animation, just output final result.
+	OUTPUT_EVENT_GUESS, // Search guess or backtrack (not an option value).
 };
 
 enum output_style {
@@ -22,6 +24,11 @@ enum output_style {
 	OUTPUT_STYLE__COUNT,
 };
 
+enum output_encoder {
+	OUTPUT_ENCODER_CGIF,    // Encode with libcgif.
+	OUTPUT_ENCODER_BUILTIN, // Encode with the built-in GIF encoder.
+};
+
 struct output_options {
 	const char *path;
 
@@ -32,13 +39,44 @@ struct output_options {
 	uint32_t border_width;
 };
 
-bool output_init(
+/**
+ * Create the output for a puzzle.
+ *
+ * \param[in]  opt     The options. Must outlive the output.
+ * \param[in]  puzzle  The puzzle to render. Must outlive the output.
+ * \return a new output, or NULL on error.
+ */
+struct output *output_create(
 		const struct options *opt,
 		const struct puzzle *puzzle);
 
+/**
+ * Render a solver event.
+ *
+ * \param[in]  output  The output to render the event to.
+ * \param[in]  event   The event.
+ * \return true on success, or false on error.
+ */
 bool output_event_notify(
+		struct output *output,
 		enum output_event event);
 
-void output_fini(void);
+/**
+ * Puzzle event callback, for rendering a puzzle's events to an output.
+ *
+ * \param[in]  pw     The output, as client private data.
+ * \param[in]  event  The event.
+ * \return true on success, or false on error.
+ */
+bool output_event_cb(
+		void *pw,
+		enum output_event event);
+
+/**
+ * Destroy an output, finishing its GIF file.
+ *
+ * \param[in]  output  The output to destroy.
+ */
+void output_free(struct output *output);
 
 #endif /* OUTPUT_H */
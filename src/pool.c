@@ -0,0 +1,170 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Worker thread pool.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <threads.h>
+
+#include "pool.h"
+
+struct pool_worker {
+	struct pool *pool;
+	size_t index;
+	thrd_t thread;
+};
+
+struct pool {
+	mtx_t lock;
+	cnd_t work;
+	cnd_t done;
+
+	pool_job_fn fn;
+	void *pw;
+	size_t count;
+	size_t next;
+
+	size_t busy;
+	size_t generation;
+	bool quit;
+
+	struct pool_worker *worker;
+	size_t worker_count;
+};
+
+/**
+ * Run jobs until there are none left.
+ *
+ * Must be called with the pool lock held.
+ */
+static void pool__run_jobs(struct pool *pool, size_t thread)
+{
+	while (pool->next < pool->count) {
+		size_t index = pool->next++;
+
+		mtx_unlock(&pool->lock);
+		pool->fn(pool->pw, index, thread);
+		mtx_lock(&pool->lock);
+	}
+}
+
+static int pool__worker(void *arg)
+{
+	struct pool_worker *worker = arg;
+	struct pool *pool = worker->pool;
+	size_t generation = 0;
+
+	mtx_lock(&pool->lock);
+	for (;;) {
+		while (generation == pool->generation && !pool->quit) {
+			cnd_wait(&pool->work, &pool->lock);
+		}
+
+		if (pool->quit) {
+			break;
+		}
+
+		generation = pool->generation;
+		pool__run_jobs(pool, worker->index);
+
+		if (--pool->busy == 0) {
+			cnd_signal(&pool->done);
+		}
+	}
+	mtx_unlock(&pool->lock);
+
+	return 0;
+}
+
+void pool_free(struct pool *pool)
+{
+	if (pool == NULL) {
+		return;
+	}
+
+	mtx_lock(&pool->lock);
+	pool->quit = true;
+	cnd_broadcast(&pool->work);
+	mtx_unlock(&pool->lock);
+
+	for (size_t i = 0; i < pool->worker_count; i++) {
+		thrd_join(pool->worker[i].thread, NULL);
+	}
+
+	cnd_destroy(&pool->done);
+	cnd_destroy(&pool->work);
+	mtx_destroy(&pool->lock);
+	free(pool->worker);
+	free(pool);
+}
+
+struct pool *pool_create(size_t thread_count)
+{
+	struct pool *pool;
+
+	pool = calloc(1, sizeof(*pool));
+	if (pool == NULL) {
+		return NULL;
+	}
+
+	if (thread_count > 1) {
+		pool->worker = calloc(thread_count - 1, sizeof(*pool->worker));
+		if (pool->worker == NULL) {
+			free(pool);
+			return NULL;
+		}
+	}
+
+	if (mtx_init(&pool->lock, mtx_plain) != thrd_success ||
+	    cnd_init(&pool->work) != thrd_success ||
+	    cnd_init(&pool->done) != thrd_success) {
+		fprintf(stderr, "Error: Failed to initialise thread pool!\n");
+		free(pool->worker);
+		free(pool);
+		return NULL;
+	}
+
+	for (size_t i = 0; i + 1 < thread_count; i++) {
+		struct pool_worker *worker = &pool->worker[i];
+
+		worker->pool = pool;
+		worker->index = i + 1;
+		if (thrd_create(&worker->thread, pool__worker,
+				worker) != thrd_success) {
+			fprintf(stderr, "Error: Failed to create thread!\n");
+			pool_free(pool);
+			return NULL;
+		}
+		pool->worker_count++;
+	}
+
+	return pool;
+}
+
+void pool_run(struct pool *pool, size_t count, pool_job_fn fn, void *pw)
+{
+	mtx_lock(&pool->lock);
+	pool->fn = fn;
+	pool->pw = pw;
+	pool->count = count;
+	pool->next = 0;
+	pool->busy = pool->worker_count;
+	pool->generation++;
+	cnd_broadcast(&pool->work);
+
+	pool__run_jobs(pool, 0);
+
+	while (pool->busy > 0) {
+		cnd_wait(&pool->done, &pool->lock);
+	}
+	mtx_unlock(&pool->lock);
+}
@@ -0,0 +1,53 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Worker thread pool.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+struct pool;
+
+/**
+ * Job callback.
+ *
+ * \param[in]  pw      Client private data.
+ * \param[in]  index   Index of the job to run.
+ * \param[in]  thread  Index of the thread running the job.
+ */
+typedef void (*pool_job_fn)(void *pw, size_t index, size_t thread);
+
+/**
+ * Create a worker thread pool.
+ *
+ * \param[in]  thread_count  Number of threads, including the caller's.
+ * \return a new pool, or NULL on error.
+ */
+struct pool *pool_create(size_t thread_count);
+
+/**
+ * Run a set of jobs on a worker thread pool, and wait for them to finish.
+ *
+ * The calling thread runs jobs too, as thread 0.
+ *
+ * \param[in]  pool   The pool to run the jobs on.
+ * \param[in]  count  Number of jobs to run.
+ * \param[in]  fn     Callback to run each job.
+ * \param[in]  pw     Client private data passed to callback.
+ */
+void pool_run(struct pool *pool, size_t count, pool_job_fn fn, void *pw);
+
+/**
+ * Destroy a worker thread pool.
+ *
+ * \param[in]  pool  The pool to destroy.
+ */
+void pool_free(struct pool *pool);
+
+#endif /* POOL_H */
@@ -5,44 +5,250 @@
  * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
  */
 
+#include <math.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
 
+#include "options.h"
 #include "output.h"
 #include "puzzle.h"
 #include "load.h"
+#include "pool.h"
+#include "bits.h"
+#include "arena.h"
+#include "cache.h"
+#include "sat.h"
+#include "tune.h"
 
-static void puzzle__line_free(struct puzzle_line *pl, size_t count)
+static void puzzle__scratch_free(struct puzzle_scratch *sc)
+{
+	free(sc->clue_start);
+	free(sc->start_min);
+	free(sc->start_max);
+	free(sc->tally);
+	free(sc->placed);
+	free(sc->trim_set);
+	free(sc->trim_clear);
+	free(sc->pre_set);
+	free(sc->pre_clear);
+	free(sc->cover);
+	free(sc->fwd);
+	free(sc->bwd);
+	free(sc->fwd_count);
+	free(sc->bwd_count);
+	free(sc->fwd_log);
+	free(sc->bwd_log);
+	free(sc->fixed);
+	free(sc->cache_key);
+	free(sc->cache_value);
+	cache_free(sc->cache);
+	free(sc->group);
+	free(sc->group_table);
+}
+
+static void puzzle__job_free(struct puzzle_job *job)
+{
+	free(job->cell);
+	free(job->count);
+	free(job->known_set);
+	free(job->known_clear);
+	free(job->clear_next);
+	free(job->start_min);
+	free(job->start_max);
+	free(job->fixed);
+}
+
+static void puzzle__probe_lines_free(struct puzzle_line *pl, size_t count)
 {
 	if (pl != NULL) {
 		for (size_t i = 0; i < count; i++) {
-			free(pl[i].clue);
-			free(pl[i].slot);
+			free(pl[i].count);
+			free(pl[i].known_set);
+			free(pl[i].known_clear);
+			free(pl[i].clear_next);
+			free(pl[i].start_min);
+			free(pl[i].start_max);
 		}
 		free(pl);
 	}
 }
 
+static void puzzle__probe_free(struct puzzle_probe *pr)
+{
+	struct puzzle *q = &pr->copy;
+
+	puzzle__probe_lines_free(q->col, q->col_count);
+	puzzle__probe_lines_free(q->row, q->row_count);
+	free(q->cell);
+	free(q->cell_col);
+	free(q->tile_dirty);
+	free(q->queue);
+	free(q->trail);
+	free(pr->seen);
+	free(pr->fix);
+}
+
 void puzzle_free(struct puzzle *p)
 {
 	if (p != NULL) {
-		free(p->name);
-		free(p->clue_start);
-		puzzle__line_free(p->col, p->col_count);
-		puzzle__line_free(p->row, p->row_count);
-		free(p);
+		pool_free(p->pool);
+		if (p->probe != NULL) {
+			for (size_t i = 0; i < p->thread_count; i++) {
+				puzzle__probe_free(&p->probe[i]);
+			}
+			free(p->probe);
+		}
+		free(p->probe_cell);
+		if (p->job != NULL) {
+			for (size_t i = 0; i < p->job_count; i++) {
+				puzzle__job_free(&p->job[i]);
+			}
+			free(p->job);
+		}
+		if (p->scratch != NULL) {
+			for (size_t i = 0; i < p->thread_count; i++) {
+				puzzle__scratch_free(&p->scratch[i]);
+			}
+			free(p->scratch);
+		}
+		free(p->cell_col);
+		free(p->tile_dirty);
+		free(p->queue);
+		free(p->trail);
+		free(p->guess);
+		free(p->solution);
+		free(p->tune);
+		if (p->changes != NULL) {
+			free(p->changes->seen);
+			free(p->changes->cell);
+			free(p->changes);
+		}
+
+		/* The puzzle itself and its lines are in the arena. */
+		arena_free(p->arena);
+	}
+}
+
+/**
+ * Reserve arena space for the cell states and the line state.
+ *
+ * These are then allocated together, after the loaded clues.
+ */
+static bool puzzle__lines_reserve(struct puzzle *p)
+{
+	size_t line_count = p->row_count + p->col_count;
+	size_t cells = p->row_count * p->col_count;
+	size_t count = 1 + 2 * line_count;
+	size_t size = cells / 4 + 1;
+	size_t clues = 0;
+
+	for (size_t i = 0; i < p->row_count; i++) {
+		clues += p->row[i].clue_count;
+	}
+	for (size_t i = 0; i < p->col_count; i++) {
+		clues += p->col[i].clue_count;
+	}
+	size += 2 * clues * sizeof(size_t);
+
+	if (p->options->style == OUTPUT_STYLE_DETAILS) {
+		count += line_count;
+		size += 2 * cells * sizeof(uint32_t);
+	}
+
+	if (p->options->packed) {
+		count += 2 * line_count;
+		size += 2 * sizeof(uint64_t) *
+				(p->col_count * bits_words(p->row_count) +
+				 p->row_count * bits_words(p->col_count));
+	} else if (p->options->line_solver != PUZZLE_LINE_SOLVER_OVERLAP) {
+		count += line_count;
+		size += 2 * cells * sizeof(uint32_t);
+	}
+
+	return arena_reserve(p->arena, count, size);
+}
+
+/** Side of the square tiles of cells the column order copy is kept in. */
+#define PUZZLE_TILE 64
+
+/**
+ * Fewest columns for column passes to use a column order copy of the cells.
+ *
+ * With fewer, a column's cells are close enough together in the row order
+ * cell states for stepping through them to be cheap.
+ */
+#define PUZZLE_COL_SHADOW_MIN 256
+
+/**
+ * Get the number of tiles across the puzzle.
+ */
+static inline size_t puzzle__tile_cols(const struct puzzle *p)
+{
+	return (p->col_count + PUZZLE_TILE - 1) / PUZZLE_TILE;
+}
+
+/**
+ * Get the number of tiles in the puzzle.
+ */
+static inline size_t puzzle__tile_count(const struct puzzle *p)
+{
+	size_t tile_rows = (p->row_count + PUZZLE_TILE - 1) / PUZZLE_TILE;
+
+	return tile_rows * puzzle__tile_cols(p);
+}
+
+/**
+ * Set a line's clue start ranges from the line's clues alone.
+ *
+ * Each clue's range runs from its left-most to its right-most packing,
+ * ignoring the line's solved slots. Any placement of the clues fits in
+ * these ranges, so they are used again whenever a line's solved slots
+ * are undone.
+ */
+static void puzzle__line_range_reset(struct puzzle_line *line)
+{
+	size_t start = 0;
+
+	for (size_t c = 0; c < line->clue_count; c++) {
+		line->start_min[c] = start;
+		line->start_max[c] = start + line->slack;
+		start += line->clue[c] + 1;
 	}
 }
 
+/**
+ * Set up the lines of a puzzle, either all the rows, or all the columns.
+ *
+ * \param[in]     p               The puzzle.
+ * \param[in]     lines           The lines to set up.
+ * \param[in]     line_count      Number of entries in lines.
+ * \param[in]     slot_count      Number of slots on each line.
+ * \param[in]     line_step       Cell index step between the lines.
+ * \param[in]     cell_step       Cell index step between each line's slots.
+ * \param[in,out] clue_total_out  Updated with the lines' clue total.
+ * \param[in,out] max_clues_out   Updated with the lines' most clues.
+ * \return true on success, or false on error.
+ */
 static bool puzzle__initialise_lines(
+		struct puzzle *p,
 		struct puzzle_line *lines,
 		size_t line_count,
 		size_t slot_count,
+		size_t line_step,
+		size_t cell_step,
 		size_t *clue_total_out,
 		size_t *max_clues_out)
 {
+	bool detail = p->options->style == OUTPUT_STYLE_DETAILS;
+	bool packed = p->options->packed;
+	bool gaps = !packed && p->options->line_solver !=
+			PUZZLE_LINE_SOLVER_OVERLAP;
+	struct arena *arena = p->arena;
 	size_t clue_total = 0;
 	size_t max_clues = 0;
 
@@ -50,9 +256,48 @@ static bool puzzle__initialise_lines(
 		struct puzzle_line *line = &lines[i];
 
 		line->update_needed = true;
+		line->cell = p->cell;
+		line->cell_first = i * line_step;
+		line->cell_step = cell_step;
 		line->slot_count = slot_count;
-		line->slot = calloc(slot_count, sizeof(*line->slot));
-		if (line->slot == NULL) {
+
+		if (detail) {
+			line->count = arena_alloc(arena,
+					slot_count * sizeof(*line->count));
+			if (line->count == NULL) {
+				return false;
+			}
+		}
+
+		if (packed) {
+			size_t words = bits_words(slot_count);
+
+			line->known_set = arena_alloc(arena,
+					words * sizeof(uint64_t));
+			line->known_clear = arena_alloc(arena,
+					words * sizeof(uint64_t));
+			if (line->known_set == NULL ||
+			    line->known_clear == NULL) {
+				return false;
+			}
+		}
+
+		if (gaps) {
+			line->clear_next = arena_alloc(arena, slot_count *
+					sizeof(*line->clear_next));
+			if (line->clear_next == NULL) {
+				return false;
+			}
+			for (size_t j = 0; j < slot_count; j++) {
+				line->clear_next[j] = (uint32_t)slot_count;
+			}
+		}
+
+		line->start_min = arena_alloc(arena, line->clue_count *
+				sizeof(*line->start_min));
+		line->start_max = arena_alloc(arena, line->clue_count *
+				sizeof(*line->start_max));
+		if (line->start_min == NULL || line->start_max == NULL) {
 			return false;
 		}
 
@@ -61,6 +306,14 @@ static bool puzzle__initialise_lines(
 		}
 		clue_total += line->clue_total;
 
+		line->queue_pos = SIZE_MAX;
+		line->slack = slot_count;
+		if (line->clue_count > 0 &&
+		    line->clue_total + line->clue_count - 1 <= slot_count) {
+			line->slack -= line->clue_total + line->clue_count - 1;
+		}
+		puzzle__line_range_reset(line);
+
 		if (line->clue_count > max_clues) {
 			max_clues = line->clue_count;
 		}
@@ -69,8 +322,9 @@ static bool puzzle__initialise_lines(
 	for (size_t i = 0; i < line_count; i++) {
 		struct puzzle_line *line = &lines[i];
 
-		for (size_t j = 0; j < line->slot_count; j++) {
-			line->slot[j].value = clue_total * 2;
+		for (size_t j = 0; detail && j < line->slot_count; j++) {
+			line->count[j] = (clue_total * 2 < UINT32_MAX) ?
+					(uint32_t)(clue_total * 2) : UINT32_MAX;
 		}
 		line->slot_max = line_count * slot_count;
 	}
@@ -82,7 +336,262 @@ static bool puzzle__initialise_lines(
 	return true;
 }
 
-struct puzzle *puzzle_create(const char *path)
+/** Number of line solves to hand the worker threads at a time, per thread. */
+#define PUZZLE_JOBS_PER_THREAD 4
+
+static bool puzzle__scratch_init(
+		const struct puzzle *p,
+		struct puzzle_scratch *sc)
+{
+	size_t slots = p->slot_count_max + 1;
+	size_t table_size = (p->clue_start_count + 1) * slots;
+
+	sc->clue_start = calloc(p->clue_start_count + 1,
+			sizeof(*sc->clue_start));
+	sc->start_min = calloc(p->clue_start_count + 1,
+			sizeof(*sc->start_min));
+	sc->start_max = calloc(p->clue_start_count + 1,
+			sizeof(*sc->start_max));
+	sc->tally = calloc(slots, sizeof(*sc->tally));
+	sc->pre_set = calloc(slots, sizeof(*sc->pre_set));
+	sc->pre_clear = calloc(slots, sizeof(*sc->pre_clear));
+	sc->cover = calloc(slots, sizeof(*sc->cover));
+	sc->fwd = calloc(table_size, sizeof(*sc->fwd));
+	sc->bwd = calloc(table_size, sizeof(*sc->bwd));
+	sc->fixed = calloc(slots, sizeof(*sc->fixed));
+	if (sc->clue_start == NULL || sc->start_min == NULL ||
+	    sc->start_max == NULL || sc->tally == NULL ||
+	    sc->pre_set == NULL || sc->pre_clear == NULL ||
+	    sc->cover == NULL || sc->fwd == NULL || sc->bwd == NULL ||
+	    sc->fixed == NULL) {
+		return false;
+	}
+
+	if (p->options->packed) {
+		sc->placed = calloc(bits_words(slots), sizeof(*sc->placed));
+		sc->trim_set = calloc(bits_words(slots),
+				sizeof(*sc->trim_set));
+		sc->trim_clear = calloc(bits_words(slots),
+				sizeof(*sc->trim_clear));
+		if (sc->placed == NULL || sc->trim_set == NULL ||
+		    sc->trim_clear == NULL) {
+			return false;
+		}
+	}
+
+	if (p->options->line_cache > 0) {
+		size_t words = bits_words(p->slot_count_max);
+
+		sc->cache = cache_create((size_t)p->options->line_cache *
+				1024 / p->thread_count);
+		sc->cache_key = calloc(2 + p->clue_start_count + 2 * words,
+				sizeof(*sc->cache_key));
+		sc->cache_value = calloc(2 + 2 * words +
+				2 * p->clue_start_count + p->slot_count_max,
+				sizeof(*sc->cache_value));
+		if (sc->cache == NULL || sc->cache_key == NULL ||
+		    sc->cache_value == NULL) {
+			return false;
+		}
+	}
+
+	if (p->options->line_dedupe) {
+		size_t buckets = 16;
+
+		while (buckets < 2 * p->slot_count_max) {
+			buckets *= 2;
+		}
+
+		sc->group = calloc(p->slot_count_max, sizeof(*sc->group));
+		sc->group_table = calloc(buckets, sizeof(*sc->group_table));
+		if (sc->group == NULL || sc->group_table == NULL) {
+			return false;
+		}
+		sc->group_mask = buckets - 1;
+	}
+
+	if (p->options->style == OUTPUT_STYLE_DETAILS) {
+		sc->fwd_count = calloc(table_size, sizeof(*sc->fwd_count));
+		sc->bwd_count = calloc(table_size, sizeof(*sc->bwd_count));
+		sc->fwd_log = calloc(table_size, sizeof(*sc->fwd_log));
+		sc->bwd_log = calloc(table_size, sizeof(*sc->bwd_log));
+		if (sc->fwd_count == NULL || sc->bwd_count == NULL ||
+		    sc->fwd_log == NULL || sc->bwd_log == NULL) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool puzzle__job_init(
+		const struct puzzle *p,
+		struct puzzle_job *job)
+{
+	size_t slots = p->slot_count_max;
+
+	job->cell = calloc(slots / 4 + 1, sizeof(*job->cell));
+	job->start_min = calloc(p->clue_start_count + 1,
+			sizeof(*job->start_min));
+	job->start_max = calloc(p->clue_start_count + 1,
+			sizeof(*job->start_max));
+	job->fixed = calloc(slots, sizeof(*job->fixed));
+	if (job->cell == NULL || job->start_min == NULL ||
+	    job->start_max == NULL || job->fixed == NULL) {
+		return false;
+	}
+
+	if (p->options->style == OUTPUT_STYLE_DETAILS) {
+		job->count = calloc(slots, sizeof(*job->count));
+		if (job->count == NULL) {
+			return false;
+		}
+	}
+
+	if (p->options->packed) {
+		job->known_set = calloc(bits_words(slots),
+				sizeof(*job->known_set));
+		job->known_clear = calloc(bits_words(slots),
+				sizeof(*job->known_clear));
+		if (job->known_set == NULL || job->known_clear == NULL) {
+			return false;
+		}
+	} else if (p->options->line_solver != PUZZLE_LINE_SOLVER_OVERLAP) {
+		job->clear_next = calloc(slots, sizeof(*job->clear_next));
+		if (job->clear_next == NULL) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static struct puzzle_line *puzzle__probe_lines_init(
+		const struct puzzle_line *lines,
+		size_t line_count,
+		uint8_t *cell,
+		bool packed)
+{
+	struct puzzle_line *copy = calloc(line_count, sizeof(*copy));
+
+	if (copy == NULL) {
+		return NULL;
+	}
+
+	for (size_t i = 0; i < line_count; i++) {
+		size_t slots = lines[i].slot_count;
+		size_t clues = lines[i].clue_count + 1;
+
+		copy[i] = lines[i];
+		copy[i].cell = cell;
+		copy[i].count = NULL;
+		copy[i].known_set = NULL;
+		copy[i].known_clear = NULL;
+		copy[i].clear_next = NULL;
+		copy[i].start_min = calloc(clues, sizeof(*copy[i].start_min));
+		copy[i].start_max = calloc(clues, sizeof(*copy[i].start_max));
+		if (lines[i].count != NULL) {
+			copy[i].count = calloc(slots, sizeof(*copy[i].count));
+		}
+		if (lines[i].clear_next != NULL) {
+			copy[i].clear_next = calloc(slots,
+					sizeof(*copy[i].clear_next));
+		}
+		if (packed) {
+			copy[i].known_set = calloc(bits_words(slots),
+					sizeof(uint64_t));
+			copy[i].known_clear = calloc(bits_words(slots),
+					sizeof(uint64_t));
+		}
+		if (copy[i].start_min == NULL || copy[i].start_max == NULL ||
+		    (lines[i].count != NULL && copy[i].count == NULL) ||
+		    (lines[i].clear_next != NULL &&
+		     copy[i].clear_next == NULL) ||
+		    (packed && (copy[i].known_set == NULL ||
+		     copy[i].known_clear == NULL))) {
+			puzzle__probe_lines_free(copy, i + 1);
+			return NULL;
+		}
+	}
+
+	return copy;
+}
+
+/**
+ * Set up a probing thread's copy of a puzzle.
+ *
+ * The copy shares the puzzle's clues and the thread's scratch space, and
+ * has line state of its own, which is refreshed from the puzzle before
+ * each round of probes.
+ */
+static bool puzzle__probe_init(
+		struct puzzle *p,
+		struct puzzle_probe *pr,
+		size_t thread)
+{
+	struct puzzle *q = &pr->copy;
+	size_t cells = p->row_count * p->col_count;
+
+	*q = *p;
+	q->name = NULL;
+	q->col = NULL;
+	q->row = NULL;
+	q->cell = NULL;
+	q->cell_col = NULL;
+	q->tile_dirty = NULL;
+	q->queue = NULL;
+	q->scratch = &p->scratch[thread];
+	q->thread_count = 1;
+	q->pool = NULL;
+	q->job = NULL;
+	q->job_count = 0;
+	q->guess = NULL;
+	q->solution = NULL;
+	q->probe = NULL;
+	q->probe_cell = NULL;
+	q->changes = NULL;
+	q->probing = true;
+
+	q->cell = calloc(cells / 4 + 1, sizeof(*q->cell));
+	if (q->cell == NULL) {
+		return false;
+	}
+
+	if (p->cell_col != NULL) {
+		q->cell_col = calloc(cells / 4 + 1, sizeof(*q->cell_col));
+		q->tile_dirty = calloc(bits_words(puzzle__tile_count(p)),
+				sizeof(*q->tile_dirty));
+		if (q->cell_col == NULL || q->tile_dirty == NULL) {
+			return false;
+		}
+	}
+
+	q->col = puzzle__probe_lines_init(p->col, p->col_count, q->cell,
+			p->options->packed);
+	q->row = puzzle__probe_lines_init(p->row, p->row_count, q->cell,
+			p->options->packed);
+	q->trail = calloc(cells, sizeof(*q->trail));
+	pr->seen = calloc(cells, sizeof(*pr->seen));
+	pr->fix = calloc(cells, sizeof(*pr->fix));
+	if (q->col == NULL || q->row == NULL || q->trail == NULL ||
+	    pr->seen == NULL || pr->fix == NULL) {
+		return false;
+	}
+
+	if (p->queue != NULL) {
+		q->queue = calloc(p->row_count + p->col_count,
+				sizeof(*q->queue));
+		if (q->queue == NULL) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+struct puzzle *puzzle_create(
+		const struct options *opt,
+		const char *path)
 {
 	struct puzzle *p;
 
@@ -91,46 +600,264 @@ struct puzzle *puzzle_create(const char *path)
 		return NULL;
 	}
 
-	if (!puzzle__initialise_lines(p->col, p->col_count, p->row_count,
+	p->options = opt;
+
+	if (!puzzle__lines_reserve(p)) {
+		fprintf(stderr, "Error: Allocation failed!\n");
+		puzzle_free(p);
+		return NULL;
+	}
+
+	p->cell = arena_alloc(p->arena, p->row_count * p->col_count / 4 + 1);
+	if (p->cell == NULL) {
+		fprintf(stderr, "Error: Allocation failed!\n");
+		puzzle_free(p);
+		return NULL;
+	}
+
+	if (!puzzle__initialise_lines(p, p->col, p->col_count,
+			p->row_count, 1, p->col_count,
 			&p->clue_total, &p->clue_start_count)) {
 		fprintf(stderr, "Error: Failed to initialise lines!\n");
 		puzzle_free(p);
 		return NULL;
 	}
 
-	if (!puzzle__initialise_lines(p->row, p->row_count, p->col_count,
+	if (!puzzle__initialise_lines(p, p->row, p->row_count,
+			p->col_count, p->col_count, 1,
 			&p->clue_total, &p->clue_start_count)) {
 		fprintf(stderr, "Error: Failed to initialise lines!\n");
 		puzzle_free(p);
 		return NULL;
 	}
 
-	p->clue_start = calloc(p->clue_start_count, sizeof(*p->clue_start));
-	if (p->clue_start == NULL) {
+	p->slot_count_max = (p->row_count > p->col_count) ?
+			p->row_count : p->col_count;
+
+	if (opt->scheduler == PUZZLE_SCHEDULER_PASS &&
+	    p->col_count >= PUZZLE_COL_SHADOW_MIN) {
+		size_t cells = p->row_count * p->col_count;
+
+		p->cell_col = calloc(cells / 4 + 1, sizeof(*p->cell_col));
+		p->tile_dirty = calloc(bits_words(puzzle__tile_count(p)),
+				sizeof(*p->tile_dirty));
+		if (p->cell_col == NULL || p->tile_dirty == NULL) {
+			fprintf(stderr, "Error: Allocation failed!\n");
+			puzzle_free(p);
+			return NULL;
+		}
+	}
+
+	if (opt->scheduler == PUZZLE_SCHEDULER_QUEUE) {
+		p->queue = calloc(p->row_count + p->col_count,
+				sizeof(*p->queue));
+		if (p->queue == NULL) {
+			fprintf(stderr, "Error: Allocation failed!\n");
+			puzzle_free(p);
+			return NULL;
+		}
+	}
+
+	if (opt->search || opt->count_solutions > 0) {
+		size_t cells = p->row_count * p->col_count;
+
+		p->trail = calloc(cells, sizeof(*p->trail));
+		p->guess = calloc(cells, sizeof(*p->guess));
+		if (p->trail == NULL || p->guess == NULL) {
+			fprintf(stderr, "Error: Allocation failed!\n");
+			puzzle_free(p);
+			return NULL;
+		}
+	}
+
+	if (opt->search || opt->count_solutions > 0 ||
+	    opt->backend == PUZZLE_BACKEND_SAT) {
+		p->solution = calloc(p->row_count * p->col_count,
+				sizeof(*p->solution));
+		if (p->solution == NULL) {
+			fprintf(stderr, "Error: Allocation failed!\n");
+			puzzle_free(p);
+			return NULL;
+		}
+	}
+
+	if (opt->output != NULL) {
+		size_t cells = p->row_count * p->col_count;
+
+		p->changes = calloc(1, sizeof(*p->changes));
+		if (p->changes == NULL) {
+			fprintf(stderr, "Error: Allocation failed!\n");
+			puzzle_free(p);
+			return NULL;
+		}
+
+		p->changes->all = true;
+		p->changes->seen = calloc(bits_words(cells), sizeof(uint64_t));
+		p->changes->cell = calloc(cells, sizeof(*p->changes->cell));
+		if (p->changes->seen == NULL || p->changes->cell == NULL) {
+			fprintf(stderr, "Error: Allocation failed!\n");
+			puzzle_free(p);
+			return NULL;
+		}
+	}
+
+	if (opt->line_solver == PUZZLE_LINE_SOLVER_AUTO) {
+		p->tune = calloc(1, sizeof(*p->tune));
+		if (p->tune == NULL) {
+			fprintf(stderr, "Error: Allocation failed!\n");
+			puzzle_free(p);
+			return NULL;
+		}
+
+		tune_default(p->tune);
+		if (opt->tuning != NULL && !tune_load(p->tune, opt->tuning)) {
+			puzzle_free(p);
+			return NULL;
+		}
+	}
+
+	p->thread_count = (opt->threads > 1) ? (size_t)opt->threads : 1;
+	p->scratch = calloc(p->thread_count, sizeof(*p->scratch));
+	if (p->scratch == NULL) {
 		fprintf(stderr, "Error: Allocation failed!\n");
 		puzzle_free(p);
 		return NULL;
 	}
 
+	for (size_t i = 0; i < p->thread_count; i++) {
+		if (!puzzle__scratch_init(p, &p->scratch[i])) {
+			fprintf(stderr, "Error: Allocation failed!\n");
+			puzzle_free(p);
+			return NULL;
+		}
+	}
+
+	if (p->thread_count > 1) {
+		p->job_count = p->thread_count * PUZZLE_JOBS_PER_THREAD;
+		p->job = calloc(p->job_count, sizeof(*p->job));
+		if (p->job == NULL) {
+			fprintf(stderr, "Error: Allocation failed!\n");
+			puzzle_free(p);
+			return NULL;
+		}
+
+		for (size_t i = 0; i < p->job_count; i++) {
+			if (!puzzle__job_init(p, &p->job[i])) {
+				fprintf(stderr, "Error: Allocation failed!\n");
+				puzzle_free(p);
+				return NULL;
+			}
+		}
+
+		p->pool = pool_create(p->thread_count);
+		if (p->pool == NULL) {
+			puzzle_free(p);
+			return NULL;
+		}
+	}
+
+	if (opt->probe) {
+		p->probe_cell = calloc(p->row_count * p->col_count,
+				sizeof(*p->probe_cell));
+		p->probe = calloc(p->thread_count, sizeof(*p->probe));
+		if (p->probe_cell == NULL || p->probe == NULL) {
+			fprintf(stderr, "Error: Allocation failed!\n");
+			puzzle_free(p);
+			return NULL;
+		}
+
+		for (size_t i = 0; i < p->thread_count; i++) {
+			if (!puzzle__probe_init(p, &p->probe[i], i)) {
+				fprintf(stderr, "Error: Allocation failed!\n");
+				puzzle_free(p);
+				return NULL;
+			}
+		}
+	}
+
 	return p;
 }
 
-static inline bool puzzle__slot_is_set(struct puzzle_slot *slot)
+/**
+ * Set the state of a cell in an array of packed cell states.
+ */
+static inline void puzzle__cell_put(
+		uint8_t *cell,
+		size_t idx,
+		enum puzzle_cell state)
+{
+	unsigned shift = idx % 4 * 2;
+
+	cell[idx / 4] = (uint8_t)((cell[idx / 4] & ~(0x3u << shift)) |
+			((unsigned)state << shift));
+}
+
+/**
+ * Set the state of a slot on a line.
+ */
+static inline void puzzle__line_put(
+		struct puzzle_line *line,
+		size_t pos,
+		enum puzzle_cell state)
+{
+	puzzle__cell_put(line->cell,
+			line->cell_first + pos * line->cell_step, state);
+}
+
+static inline bool puzzle__slot_is_done(
+		const struct puzzle_line *line,
+		size_t pos)
+{
+	return puzzle_line_get(line, pos) != PUZZLE_CELL_UNKNOWN;
+}
+
+/**
+ * Check whether a slot on a line is known to be set.
+ *
+ * Uses the packed line state, when it is enabled.
+ */
+static inline bool puzzle__line_is_set(
+		const struct puzzle_line *line,
+		size_t pos)
 {
-	return slot->done && slot->value > 0;
+	if (line->known_set != NULL) {
+		return bits_test(line->known_set, pos);
+	}
+
+	return puzzle_line_get(line, pos) == PUZZLE_CELL_SET;
 }
 
-static inline bool puzzle__slot_is_clear(struct puzzle_slot *slot)
+/**
+ * Check whether a slot on a line is known to be clear.
+ *
+ * Uses the packed line state, when it is enabled.
+ */
+static inline bool puzzle__line_is_clear(
+		const struct puzzle_line *line,
+		size_t pos)
 {
-	return slot->done && slot->value == 0;
+	if (line->known_clear != NULL) {
+		return bits_test(line->known_clear, pos);
+	}
+
+	return puzzle_line_get(line, pos) == PUZZLE_CELL_CLEAR;
 }
 
 static inline size_t puzzle__available_gap(
 		const struct puzzle_line *line,
 		size_t pos)
 {
+	if (line->known_clear != NULL) {
+		return bits_find(line->known_clear, pos,
+				line->slot_count) - pos;
+	}
+
+	if (line->clear_next != NULL) {
+		return line->clear_next[pos] - pos;
+	}
+
 	for (size_t i = pos; i < line->slot_count; i++) {
-		if (puzzle__slot_is_clear(&line->slot[i])) {
+		if (puzzle_line_get(line, i) == PUZZLE_CELL_CLEAR) {
 			return i - pos;
 		}
 	}
@@ -149,7 +876,7 @@ static inline bool puzzle__can_place_single_clue(
 	}
 
 	if (pos + clue < line->slot_count &&
-	    puzzle__slot_is_set(&line->slot[pos + clue])) {
+	    puzzle__line_is_set(line, pos + clue)) {
 		return false;
 	}
 
@@ -157,7 +884,7 @@ static inline bool puzzle__can_place_single_clue(
 }
 
 static inline bool puzzle__can_place_clue(
-		const struct puzzle *p,
+		struct puzzle_scratch *sc,
 		const struct puzzle_line *line,
 		size_t clue_idx,
 		size_t pos)
@@ -165,11 +892,16 @@ static inline bool puzzle__can_place_clue(
 	for (size_t c = clue_idx; c < line->clue_count; c++) {
 		bool placed = false;
 
-		for (size_t i = pos; i < line->slot_count; i++) {
+		if (pos < line->start_min[c]) {
+			pos = line->start_min[c];
+		}
+
+		for (size_t i = pos; i < line->slot_count &&
+				i <= line->start_max[c]; i++) {
 			size_t gap = puzzle__available_gap(line, i);
 			if (puzzle__can_place_single_clue(line, line->clue[c],
 					gap, i)) {
-				p->clue_start[c] = i;
+				sc->clue_start[c] = i;
 				placed = true;
 				pos = i + line->clue[c] + 1;
 				break;
@@ -184,16 +916,38 @@ static inline bool puzzle__can_place_clue(
 	return true;
 }
 
+static inline bool puzzle__missed_set_cell_packed(
+		struct puzzle_scratch *sc,
+		struct puzzle_line *line)
+{
+	size_t words = bits_words(line->slot_count);
+
+	for (size_t w = 0; w < words; w++) {
+		sc->placed[w] = 0;
+	}
+
+	for (size_t c = 0; c < line->clue_count; c++) {
+		bits_set_range(sc->placed, sc->clue_start[c],
+				sc->clue_start[c] + line->clue[c]);
+	}
+
+	return bits_any_andnot(line->known_set, sc->placed, words);
+}
+
 static inline bool puzzle__missed_set_cell(
-		const struct puzzle *p,
+		struct puzzle_scratch *sc,
 		struct puzzle_line *line)
 {
+	if (line->known_set != NULL) {
+		return puzzle__missed_set_cell_packed(sc, line);
+	}
+
 	for (size_t s = 0; s < line->slot_count; s++) {
-		if (puzzle__slot_is_set(&line->slot[s])) {
+		if (puzzle_line_get(line, s) == PUZZLE_CELL_SET) {
 			bool inside = false;
 			for (size_t c = 0; c < line->clue_count; c++) {
-				if (s >= p->clue_start[c] &&
-				    s < p->clue_start[c] + line->clue[c]) {
+				if (s >= sc->clue_start[c] &&
+				    s < sc->clue_start[c] + line->clue[c]) {
 					inside = true;
 					break;
 				}
@@ -208,162 +962,3341 @@ static inline bool puzzle__missed_set_cell(
 }
 
 static inline bool puzzle__try_place_clues(
-		const struct puzzle *p,
+		struct puzzle_scratch *sc,
 		struct puzzle_line *line,
 		size_t clue_idx,
 		size_t pos)
 {
-	if (puzzle__can_place_clue(p, line, clue_idx, pos)) {
-		if (puzzle__missed_set_cell(p, line)) {
+	if (puzzle__can_place_clue(sc, line, clue_idx, pos)) {
+		if (puzzle__missed_set_cell(sc, line)) {
 			return true;
 		}
 
 		for (size_t c = 0; c < line->clue_count; c++) {
-			size_t start = p->clue_start[c];
+			size_t start = sc->clue_start[c];
 			for (size_t s = start; s < start + line->clue[c]; s++) {
-				if (line->slot[s].done == false) {
-					line->slot[s].value++;
-				}
+				sc->tally[s]++;
+			}
+			if (start < sc->start_min[c]) {
+				sc->start_min[c] = start;
+			}
+			if (start > sc->start_max[c]) {
+				sc->start_max[c] = start;
 			}
 		}
 
-		line->slot_max++;
+		sc->tally_max++;
 		return true;
 	}
 
 	return false;
 }
 
-static void puzzle__solve_slot_done(
-		struct puzzle *p,
-		struct puzzle_line *lines,
-		size_t line_idx,
-		size_t slot_idx)
+/**
+ * Get the line for a work queue line ID.
+ *
+ * Rows have IDs [0, row_count) and columns follow them.
+ *
+ * \param[in]  p         The puzzle.
+ * \param[in]  id        Line ID.
+ * \param[out] line_idx  Returns index of the line in the returned array.
+ * \return the array of lines containing the line.
+ */
+static inline struct puzzle_line *puzzle__queue_lines(
+		const struct puzzle *p,
+		size_t id,
+		size_t *line_idx)
 {
-	struct puzzle_line *line = &lines[line_idx];
-	struct puzzle_line *other = (lines == p->col) ?
-			&p->row[slot_idx] : &p->col[slot_idx];
-	struct puzzle_slot *other_slot = &other->slot[line_idx];
+	if (id < p->row_count) {
+		*line_idx = id;
+		return p->row;
+	}
 
-	line->slot[slot_idx].done = true;
-	line->total++;
+	*line_idx = id - p->row_count;
+	return p->col;
+}
 
-	other->update_needed = true;
-	other_slot->value = line->slot[slot_idx].value;
-	other_slot->done = true;
-	other->total++;
+static inline struct puzzle_line *puzzle__queue_line(
+		const struct puzzle *p,
+		size_t id)
+{
+	size_t line_idx;
+	struct puzzle_line *lines = puzzle__queue_lines(p, id, &line_idx);
 
-	p->cells_complete++;
+	return &lines[line_idx];
 }
 
-static bool puzzle__solve_line(
+/**
+ * Check whether a line should be solved before another.
+ *
+ * Lines with more newly solved slots go first, then lines with less slack.
+ */
+static inline bool puzzle__queue_before(
+		const struct puzzle *p,
+		size_t a,
+		size_t b)
+{
+	const struct puzzle_line *la = puzzle__queue_line(p, a);
+	const struct puzzle_line *lb = puzzle__queue_line(p, b);
+
+	if (la->fresh != lb->fresh) {
+		return la->fresh > lb->fresh;
+	}
+
+	if (la->slack != lb->slack) {
+		return la->slack < lb->slack;
+	}
+
+	return a < b;
+}
+
+static inline void puzzle__queue_place(
 		struct puzzle *p,
-		struct puzzle_line *lines,
-		size_t line_idx)
+		size_t pos,
+		size_t id)
 {
-	bool placed;
-	size_t clue;
-	struct puzzle_line *line = &lines[line_idx];
+	p->queue[pos] = id;
+	puzzle__queue_line(p, id)->queue_pos = pos;
+}
 
-	line->slot_max = 0;
-	for (size_t s = 0; s < line->slot_count; s++) {
-		if (line->slot[s].done == false) {
-			line->slot[s].value = 0;
+static void puzzle__queue_sift_up(struct puzzle *p, size_t pos)
+{
+	size_t id = p->queue[pos];
+
+	while (pos > 0) {
+		size_t parent = (pos - 1) / 2;
+
+		if (!puzzle__queue_before(p, id, p->queue[parent])) {
+			break;
 		}
+
+		puzzle__queue_place(p, pos, p->queue[parent]);
+		pos = parent;
 	}
 
-	placed = puzzle__try_place_clues(p, line, 0, 0);
-	if (!placed) {
-		fprintf(stderr, "ERROR: Couldn't fit clues on line!\n");
-		return false;
+	puzzle__queue_place(p, pos, id);
+}
+
+static void puzzle__queue_sift_down(struct puzzle *p, size_t pos)
+{
+	size_t id = p->queue[pos];
+
+	for (;;) {
+		size_t child = pos * 2 + 1;
+
+		if (child >= p->queue_count) {
+			break;
+		}
+
+		if (child + 1 < p->queue_count &&
+		    puzzle__queue_before(p, p->queue[child + 1],
+				p->queue[child])) {
+			child++;
+		}
+
+		if (!puzzle__queue_before(p, p->queue[child], id)) {
+			break;
+		}
+
+		puzzle__queue_place(p, pos, p->queue[child]);
+		pos = child;
+	}
+
+	puzzle__queue_place(p, pos, id);
+}
+
+/**
+ * Add a line to the work queue, or update its place if already queued.
+ *
+ * A line's priority only increases while it is queued.
+ */
+static void puzzle__queue_push(struct puzzle *p, size_t id)
+{
+	struct puzzle_line *line = puzzle__queue_line(p, id);
+
+	if (line->queue_pos == SIZE_MAX) {
+		line->queue_pos = p->queue_count++;
+		p->queue[line->queue_pos] = id;
+	}
+
+	puzzle__queue_sift_up(p, line->queue_pos);
+}
+
+static size_t puzzle__queue_pop(struct puzzle *p)
+{
+	size_t id = p->queue[0];
+
+	puzzle__queue_line(p, id)->queue_pos = SIZE_MAX;
+
+	p->queue_count--;
+	if (p->queue_count > 0) {
+		puzzle__queue_place(p, 0, p->queue[p->queue_count]);
+		puzzle__queue_sift_down(p, 0);
+	}
+
+	return id;
+}
+
+/**
+ * Update a line's gap index for a slot that became clear or unsolved.
+ *
+ * Each slot's entry is the first clear slot at or after it, so the slot
+ * and the slots before it, back to the previous clear slot, are updated.
+ */
+static void puzzle__line_gap_update(
+		struct puzzle_line *line,
+		size_t slot_idx)
+{
+	uint32_t next;
+
+	if (line->clear_next == NULL) {
+		return;
+	}
+
+	if (puzzle_line_get(line, slot_idx) == PUZZLE_CELL_CLEAR) {
+		next = (uint32_t)slot_idx;
+	} else if (slot_idx + 1 < line->slot_count) {
+		next = line->clear_next[slot_idx + 1];
+	} else {
+		next = (uint32_t)line->slot_count;
+	}
+
+	line->clear_next[slot_idx] = next;
+	for (size_t s = slot_idx; s-- > 0 && line->clear_next[s] != s;) {
+		line->clear_next[s] = next;
+	}
+}
+
+/**
+ * Narrow a line's clue start ranges for a slot solved by the crossing line.
+ *
+ * A clear slot moves the ends of the ranges of clues that would cover it,
+ * and a set slot bounds the first clue's highest start and the last clue's
+ * lowest start. The clues' order is then kept: each clue starts after the
+ * previous clue and a gap.
+ *
+ * Ranges only ever narrow to starts that can't fit, so no placement of the
+ * clues is lost. Placements are only ruled out by a slot that a clue's
+ * range covers, so a clear slot outside every range leaves the line's
+ * solve unchanged.
+ *
+ * \param[in]  line      The line.
+ * \param[in]  slot_idx  The solved slot.
+ * \param[in]  state     The slot's new state.
+ * \return true if the line needs to be solved again, or false otherwise.
+ */
+static bool puzzle__line_range_narrow(
+		struct puzzle_line *line,
+		size_t slot_idx,
+		enum puzzle_cell state)
+{
+	size_t *start_min = line->start_min;
+	size_t *start_max = line->start_max;
+	size_t k = line->clue_count;
+	bool covered = false;
+	bool changed = false;
+
+	if (state == PUZZLE_CELL_SET) {
+		if (k == 0) {
+			return true;
+		}
+		if (start_max[0] > slot_idx) {
+			start_max[0] = slot_idx;
+			changed = true;
+		}
+		if (slot_idx + 1 >= line->clue[k - 1] &&
+		    start_min[k - 1] < slot_idx + 1 - line->clue[k - 1]) {
+			start_min[k - 1] = slot_idx + 1 - line->clue[k - 1];
+			changed = true;
+		}
+		covered = true;
 	}
 
-	clue = line->clue_count - 1;
+	for (size_t c = 0; c < k && start_min[c] <= slot_idx; c++) {
+		size_t len = line->clue[c];
 
-	while (clue < line->clue_count) {
-		size_t pos = p->clue_start[clue];
+		if (slot_idx >= start_max[c] + len) {
+			continue;
+		}
 
-		if (puzzle__slot_is_set(&line->slot[pos]) ||
-		    pos == line->slot_count) {
-			clue--;
+		covered = true;
+		if (state != PUZZLE_CELL_CLEAR) {
 			continue;
 		}
-		pos++;
 
-		placed = puzzle__try_place_clues(p, line, clue, pos);
-		if (placed) {
-			clue = line->clue_count - 1;
-		} else {
-			clue--;
+		if (slot_idx < start_min[c] + len) {
+			start_min[c] = slot_idx + 1;
+			changed = true;
+		}
+		if (slot_idx >= start_max[c] && slot_idx >= len) {
+			start_max[c] = slot_idx - len;
+			changed = true;
 		}
 	}
 
-	for (size_t s = 0; s < line->slot_count; s++) {
-		if (line->slot[s].done == false) {
-			if (line->slot[s].value == line->slot_max ||
-			    line->slot[s].value == 0) {
-				puzzle__solve_slot_done(p, lines, line_idx, s);
-			}
+	for (size_t c = 1; changed && c < k; c++) {
+		size_t min = start_min[c - 1] + line->clue[c - 1] + 1;
+
+		if (start_min[c] < min) {
+			start_min[c] = min;
 		}
 	}
 
-	line->update_needed = false;
-	output_event_notify(OUTPUT_EVENT_LINE);
-	return true;
+	for (size_t c = k; changed && c-- > 1;) {
+		size_t gap = line->clue[c - 1] + 1;
+
+		if (start_max[c] >= gap &&
+		    start_max[c - 1] > start_max[c] - gap) {
+			start_max[c - 1] = start_max[c] - gap;
+		}
+	}
+
+	return covered || changed;
 }
 
-static bool puzzle__solve_pass(
-		struct puzzle *p,
-		struct puzzle_line *lines,
-		size_t line_count)
+/**
+ * Mark a slot on a line as solved.
+ *
+ * Only the line itself is updated. The crossing line is updated later by
+ * \ref puzzle__solve_slot_done, so line solves can run on worker threads.
+ */
+static void puzzle__line_slot_done(
+		struct puzzle_scratch *sc,
+		struct puzzle_line *line,
+		size_t slot_idx,
+		bool set)
 {
-	for (size_t i = 0; i < line_count; i++) {
-		if (lines[i].total == lines[i].slot_count ||
-		    lines[i].update_needed == false) {
-			continue;
-		}
-		if (!puzzle__solve_line(p, lines, i)) {
-			return false;
+	puzzle__line_put(line, slot_idx, set ?
+			PUZZLE_CELL_SET : PUZZLE_CELL_CLEAR);
+	line->total++;
+
+	if (!set) {
+		puzzle__line_gap_update(line, slot_idx);
+	}
+
+	if (line->known_set != NULL) {
+		if (set) {
+			bits_set(line->known_set, slot_idx);
+		} else {
+			bits_set(line->known_clear, slot_idx);
 		}
 	}
 
-	output_event_notify(OUTPUT_EVENT_PASS);
-	return true;
+	sc->fixed[sc->fixed_count++] = slot_idx;
 }
 
-bool puzzle_is_complete(const struct puzzle *p)
+/**
+ * Note that a cell's state changed in the row order cell states.
+ *
+ * The cell's tile of the column order copy is then out of date.
+ */
+static inline void puzzle__tile_dirty(
+		struct puzzle *p,
+		size_t row,
+		size_t col)
 {
-	return p->cells_complete == p->col_count * p->row_count;
+	if (p->tile_dirty != NULL) {
+		bits_set(p->tile_dirty, row / PUZZLE_TILE *
+				puzzle__tile_cols(p) + col / PUZZLE_TILE);
+	}
 }
 
-bool puzzle_solve(struct puzzle *p)
+/**
+ * Copy a tile of the row order cell states to the column order copy.
+ *
+ * Tiles are small enough for the rows being read and the columns being
+ * written to stay in cache while the tile is transposed.
+ */
+static void puzzle__tile_copy(struct puzzle *p, size_t tile)
 {
-	size_t cells_complete = 0;
-	bool ok = true;
-	int pass = 0;
+	size_t row = tile / puzzle__tile_cols(p) * PUZZLE_TILE;
+	size_t col = tile % puzzle__tile_cols(p) * PUZZLE_TILE;
+	size_t row_end = row + PUZZLE_TILE;
+	size_t col_end = col + PUZZLE_TILE;
 
-	while (ok && !puzzle_is_complete(p)) {
-		bool vertical = pass & 0x1;
-		struct puzzle_line *lines = vertical ? p->col : p->row;
-		size_t line_count = vertical ? p->col_count : p->row_count;
+	if (row_end > p->row_count) {
+		row_end = p->row_count;
+	}
+	if (col_end > p->col_count) {
+		col_end = p->col_count;
+	}
 
-		if (!puzzle__solve_pass(p, lines, line_count)) {
-			ok = false;
-			break;
+	for (size_t c = col; c < col_end; c++) {
+		for (size_t r = row; r < row_end; r++) {
+			puzzle__cell_put(p->cell_col, c * p->row_count + r,
+					puzzle_cell_get(p->cell,
+						r * p->col_count + c));
 		}
+	}
+}
+
+/**
+ * Switch the columns between views of the row order cell states and views
+ * of the column order copy.
+ *
+ * Column passes solve columns from the column order copy, if the puzzle
+ * has one, so each column's cells are together. The copy's out of date
+ * tiles are refreshed first. While the columns use the copy, cells the
+ * column solves fix are written back to the row order cell states by
+ * \ref puzzle__solve_slot_done.
+ */
+static void puzzle__col_shadow(struct puzzle *p, bool use)
+{
+	size_t tiles = puzzle__tile_count(p);
+
+	if (p->cell_col == NULL) {
+		return;
+	}
 
+	for (size_t t = bits_find(p->tile_dirty, 0, tiles); use && t < tiles;
+			t = bits_find(p->tile_dirty, t + 1, tiles)) {
+		bits_clear(p->tile_dirty, t);
+		puzzle__tile_copy(p, t);
+	}
+
+	for (size_t c = 0; c < p->col_count; c++) {
+		struct puzzle_line *line = &p->col[c];
+
+		line->cell = use ? p->cell_col : p->cell;
+		line->cell_first = use ? c * p->row_count : c;
+		line->cell_step = use ? 1 : p->col_count;
+	}
+
+	p->col_shadow = use;
+}
+
+/**
+ * Note that a cell's output may have changed, for the next frame.
+ */
+static inline void puzzle__changed(
+		struct puzzle *p,
+		size_t row,
+		size_t col)
+{
+	struct puzzle_changes *ch = p->changes;
+	size_t cell = row * p->col_count + col;
+
+	if (ch == NULL || ch->all || bits_test(ch->seen, cell)) {
+		return;
+	}
+
+	bits_set(ch->seen, cell);
+	ch->cell[ch->count++] = cell;
+}
+
+/**
+ * Note that the output of every cell on a line may have changed.
+ *
+ * With the detail style, a line solve changes the placement counts of
+ * all the line's unsolved slots.
+ */
+static void puzzle__changed_line(
+		struct puzzle *p,
+		const struct puzzle_line *lines,
+		size_t line_idx)
+{
+	bool vertical = (lines == p->col);
+
+	if (p->changes == NULL) {
+		return;
+	}
+
+	for (size_t s = 0; s < lines[line_idx].slot_count; s++) {
 		if (vertical) {
-			if (cells_complete == p->cells_complete) {
-				fprintf(stderr, "Couldn't solve puzzle!\n");
-				break;
-			}
+			puzzle__changed(p, s, line_idx);
+		} else {
+			puzzle__changed(p, line_idx, s);
+		}
+	}
+}
 
-			cells_complete = p->cells_complete;
+void puzzle_changes_clear(struct puzzle_changes *changes)
+{
+	for (size_t i = 0; i < changes->count; i++) {
+		bits_clear(changes->seen, changes->cell[i]);
+	}
+
+	changes->count = 0;
+	changes->all = false;
+}
+
+/**
+ * Update the crossing line for a slot solved on a line.
+ *
+ * The cell state is shared by both lines, so it is already there, unless
+ * a column solved it from the column order copy. The crossing line is only
+ * queued to be solved again if the slot can change its solve.
+ */
+static void puzzle__solve_slot_done(
+		struct puzzle *p,
+		struct puzzle_line *lines,
+		size_t line_idx,
+		size_t slot_idx)
+{
+	bool vertical = (lines == p->col);
+	enum puzzle_cell state = puzzle_line_get(&lines[line_idx], slot_idx);
+	struct puzzle_line *other = vertical ?
+			&p->row[slot_idx] : &p->col[slot_idx];
+	size_t row = vertical ? slot_idx : line_idx;
+	size_t col = vertical ? line_idx : slot_idx;
+	bool needed;
+
+	if (vertical && p->col_shadow) {
+		puzzle__cell_put(p->cell, row * p->col_count + col, state);
+	} else {
+		puzzle__tile_dirty(p, row, col);
+	}
+
+	needed = puzzle__line_range_narrow(other, line_idx, state);
+	if (needed) {
+		other->update_needed = true;
+		other->fresh++;
+	}
+	other->total++;
+
+	if (state == PUZZLE_CELL_CLEAR) {
+		puzzle__line_gap_update(other, line_idx);
+	}
+
+	if (other->known_set != NULL) {
+		if (state == PUZZLE_CELL_SET) {
+			bits_set(other->known_set, line_idx);
+		} else {
+			bits_set(other->known_clear, line_idx);
 		}
+	}
 
-		pass++;
+	p->cells_complete++;
+	puzzle__changed(p, row, col);
+
+	if (p->trail != NULL) {
+		p->trail[p->trail_count++] = row * p->col_count + col;
+	}
+
+	if (needed && p->queue != NULL) {
+		puzzle__queue_push(p, vertical ?
+				slot_idx : p->row_count + slot_idx);
+	}
+}
+
+/**
+ * Denominator for the slot counts of a line with too many placements to count.
+ *
+ * Once a line's placement count doesn't fit in a slot count, its slot counts
+ * are stored as a ratio of this, rather than as counts.
+ */
+#define PUZZLE_COUNT_SCALE ((size_t)UINT32_MAX)
+
+/**
+ * Get a line's slot_max for a total number of placements.
+ */
+static inline size_t puzzle__count_max(size_t total)
+{
+	return (total <= PUZZLE_COUNT_SCALE) ? total : PUZZLE_COUNT_SCALE;
+}
+
+/**
+ * Narrow a slot's placement count to a slot count.
+ *
+ * \param[in]  count  Number of placements covering the slot.
+ * \param[in]  total  Total number of placements of the line.
+ * \return the slot count, out of \ref puzzle__count_max of the total.
+ */
+static inline uint32_t puzzle__count_narrow(size_t count, size_t total)
+{
+	if (total <= PUZZLE_COUNT_SCALE) {
+		return (uint32_t)count;
+	}
+
+	return (uint32_t)((double)count / (double)total *
+			(double)PUZZLE_COUNT_SCALE + 0.5);
+}
+
+/**
+ * Keep the placement counts of a line's unsolved slots, for the detail style.
+ *
+ * \param[in]  line       The line.
+ * \param[in]  tally      Number of placements covering each slot.
+ * \param[in]  tally_max  Total number of placements.
+ */
+static void puzzle__line_counts_keep(
+		struct puzzle_line *line,
+		const size_t *tally,
+		size_t tally_max)
+{
+	if (line->count == NULL) {
+		return;
+	}
+
+	line->slot_max = puzzle__count_max(tally_max);
+	for (size_t s = 0; s < line->slot_count; s++) {
+		if (!puzzle__slot_is_done(line, s)) {
+			line->count[s] = puzzle__count_narrow(
+					tally[s], tally_max);
+		}
 	}
+}
+
+/**
+ * Keep the clue start ranges found by a line solve.
+ *
+ * The ranges hold exactly the starts of the placements that fit the
+ * line's solved slots, and are narrowed from there as slots are solved
+ * by the crossing lines.
+ */
+static void puzzle__line_range_keep(
+		const struct puzzle_scratch *sc,
+		struct puzzle_line *line)
+{
+	memcpy(line->start_min, sc->start_min,
+			line->clue_count * sizeof(*line->start_min));
+	memcpy(line->start_max, sc->start_max,
+			line->clue_count * sizeof(*line->start_max));
+}
+
+static bool puzzle__solve_line_enumerate(
+		struct puzzle_scratch *sc,
+		struct puzzle_line *line)
+{
+	size_t clue;
 
-	output_event_notify(OUTPUT_EVENT_FINAL);
+	sc->tally_max = 0;
+	for (size_t s = 0; s < line->slot_count; s++) {
+		sc->tally[s] = 0;
+	}
+	for (size_t c = 0; c < line->clue_count; c++) {
+		sc->start_min[c] = SIZE_MAX;
+		sc->start_max[c] = 0;
+	}
+
+	if (puzzle__try_place_clues(sc, line, 0, 0)) {
+		clue = line->clue_count - 1;
+
+		while (clue < line->clue_count) {
+			size_t pos = sc->clue_start[clue];
+
+			if (pos >= line->start_max[clue] ||
+			    puzzle__line_is_set(line, pos)) {
+				clue--;
+				continue;
+			}
+			pos++;
+
+			if (puzzle__try_place_clues(sc, line, clue, pos)) {
+				clue = line->clue_count - 1;
+			} else {
+				clue--;
+			}
+		}
+	}
+
+	puzzle__line_counts_keep(line, sc->tally, sc->tally_max);
+
+	if (sc->tally_max == 0) {
+		/* No placement fits the solved slots. */
+		return false;
+	}
+
+	puzzle__line_range_keep(sc, line);
+
+	for (size_t s = 0; s < line->slot_count; s++) {
+		if (!puzzle__slot_is_done(line, s) &&
+		    (sc->tally[s] == sc->tally_max || sc->tally[s] == 0)) {
+			puzzle__line_slot_done(sc, line, s, sc->tally[s] > 0);
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Check whether a line's slots in range [start, end) contain no set slot.
+ */
+static inline bool puzzle__range_unset(
+		const struct puzzle_scratch *sc,
+		size_t start,
+		size_t end)
+{
+	return sc->pre_set[end] == sc->pre_set[start];
+}
+
+/**
+ * Check whether a line's slots in range [start, end) contain no clear slot.
+ */
+static inline bool puzzle__range_unclear(
+		const struct puzzle_scratch *sc,
+		size_t start,
+		size_t end)
+{
+	return sc->pre_clear[end] == sc->pre_clear[start];
+}
+
+/**
+ * Check whether clues [0, clue) fit before a clue starting at pos.
+ *
+ * Needs the prefix table to be filled for clues [0, clue).
+ */
+static inline bool puzzle__overlap_fits_before(
+		const struct puzzle_scratch *sc,
+		const struct puzzle_line *line,
+		size_t clue,
+		size_t pos)
+{
+	size_t stride = line->slot_count + 1;
+
+	if (clue == 0) {
+		return sc->fwd[pos];
+	}
+
+	return pos > 0 && !puzzle__line_is_set(line, pos - 1) &&
+			sc->fwd[clue * stride + pos - 1];
+}
+
+/**
+ * Check whether clues (clue, clue_count) fit after a clue ending at end.
+ *
+ * Needs the suffix table to be filled for clues (clue, clue_count).
+ */
+static inline bool puzzle__overlap_fits_after(
+		const struct puzzle_scratch *sc,
+		const struct puzzle_line *line,
+		size_t clue,
+		size_t end)
+{
+	size_t stride = line->slot_count + 1;
+
+	if (clue + 1 == line->clue_count) {
+		return sc->bwd[line->clue_count * stride + end];
+	}
+
+	return end < line->slot_count &&
+			!puzzle__line_is_set(line, end) &&
+			sc->bwd[(clue + 1) * stride + end + 1];
+}
+
+/**
+ * Fill the prefix and suffix placement tables for a line.
+ *
+ * The prefix table entry `fwd[c][i]` records whether the first `c` clues
+ * can be placed in slots [0, i) and the suffix table entry `bwd[c][i]`
+ * records whether clues [c, clue_count) can be placed in slots [i, n).
+ * The first and last position at which each clue fits are its left-most
+ * and right-most packing.
+ */
+static void puzzle__overlap_pack(
+		struct puzzle_scratch *sc,
+		const struct puzzle_line *line)
+{
+	size_t n = line->slot_count;
+	size_t k = line->clue_count;
+	size_t stride = n + 1;
+
+	sc->pre_set[0] = 0;
+	sc->pre_clear[0] = 0;
+	for (size_t s = 0; s < n; s++) {
+		sc->pre_set[s + 1] = sc->pre_set[s] +
+				puzzle__line_is_set(line, s);
+		sc->pre_clear[s + 1] = sc->pre_clear[s] +
+				puzzle__line_is_clear(line, s);
+	}
+
+	for (size_t i = 0; i <= n; i++) {
+		sc->fwd[i] = puzzle__range_unset(sc, 0, i);
+		sc->bwd[k * stride + i] = puzzle__range_unset(sc, i, n);
+	}
+
+	for (size_t c = 1; c <= k; c++) {
+		size_t len = line->clue[c - 1];
+		bool *row = &sc->fwd[c * stride];
+
+		for (size_t i = 0; i <= n; i++) {
+			row[i] = i > 0 && row[i - 1] &&
+					!puzzle__line_is_set(line, i - 1);
+			if (!row[i] && i >= len &&
+			    puzzle__range_unclear(sc, i - len, i)) {
+				row[i] = puzzle__overlap_fits_before(
+						sc, line, c - 1, i - len);
+			}
+		}
+	}
+
+	for (size_t c = k; c-- > 0;) {
+		size_t len = line->clue[c];
+		bool *row = &sc->bwd[c * stride];
+
+		for (size_t i = n + 1; i-- > 0;) {
+			row[i] = i < n && row[i + 1] &&
+					!puzzle__line_is_set(line, i);
+			if (!row[i] && i + len <= n &&
+			    puzzle__range_unclear(sc, i, i + len)) {
+				row[i] = puzzle__overlap_fits_after(
+						sc, line, c, i + len);
+			}
+		}
+	}
+}
+
+static inline size_t puzzle__sat_add(size_t a, size_t b)
+{
+	return (a > SIZE_MAX - b) ? SIZE_MAX : a + b;
+}
+
+static inline size_t puzzle__sat_mul(size_t a, size_t b)
+{
+	return (a != 0 && b > SIZE_MAX / a) ? SIZE_MAX : a * b;
+}
+
+static inline double puzzle__log_add(double a, double b)
+{
+	if (a < b) {
+		double tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	if (b == -INFINITY) {
+		return a;
+	}
+
+	return a + log1p(exp(b - a));
+}
+
+static inline size_t puzzle__count_before(
+		const struct puzzle_scratch *sc,
+		const struct puzzle_line *line,
+		size_t clue,
+		size_t pos)
+{
+	size_t stride = line->slot_count + 1;
+
+	if (clue == 0) {
+		return sc->fwd_count[pos];
+	}
+
+	if (pos == 0 || puzzle__line_is_set(line, pos - 1)) {
+		return 0;
+	}
+
+	return sc->fwd_count[clue * stride + pos - 1];
+}
+
+static inline size_t puzzle__count_after(
+		const struct puzzle_scratch *sc,
+		const struct puzzle_line *line,
+		size_t clue,
+		size_t end)
+{
+	size_t stride = line->slot_count + 1;
+
+	if (clue + 1 == line->clue_count) {
+		return sc->bwd_count[line->clue_count * stride + end];
+	}
+
+	if (end == line->slot_count || puzzle__line_is_set(line, end)) {
+		return 0;
+	}
+
+	return sc->bwd_count[(clue + 1) * stride + end + 1];
+}
+
+static inline double puzzle__log_before(
+		const struct puzzle_scratch *sc,
+		const struct puzzle_line *line,
+		size_t clue,
+		size_t pos)
+{
+	size_t stride = line->slot_count + 1;
+
+	if (clue == 0) {
+		return sc->fwd_log[pos];
+	}
+
+	if (pos == 0 || puzzle__line_is_set(line, pos - 1)) {
+		return -INFINITY;
+	}
+
+	return sc->fwd_log[clue * stride + pos - 1];
+}
+
+static inline double puzzle__log_after(
+		const struct puzzle_scratch *sc,
+		const struct puzzle_line *line,
+		size_t clue,
+		size_t end)
+{
+	size_t stride = line->slot_count + 1;
+
+	if (clue + 1 == line->clue_count) {
+		return sc->bwd_log[line->clue_count * stride + end];
+	}
+
+	if (end == line->slot_count || puzzle__line_is_set(line, end)) {
+		return -INFINITY;
+	}
+
+	return sc->bwd_log[(clue + 1) * stride + end + 1];
+}
+
+/**
+ * Fill the prefix and suffix placement count tables for a line.
+ *
+ * These follow the same recurrences as the placement tables built by
+ * \ref puzzle__overlap_pack, but count the placements, saturating at
+ * SIZE_MAX. Needs the slot prefix sums from \ref puzzle__overlap_pack.
+ */
+static void puzzle__count_pack(
+		struct puzzle_scratch *sc,
+		const struct puzzle_line *line)
+{
+	size_t n = line->slot_count;
+	size_t k = line->clue_count;
+	size_t stride = n + 1;
+
+	for (size_t i = 0; i <= n; i++) {
+		sc->fwd_count[i] = puzzle__range_unset(sc, 0, i);
+		sc->bwd_count[k * stride + i] =
+				puzzle__range_unset(sc, i, n);
+	}
+
+	for (size_t c = 1; c <= k; c++) {
+		size_t len = line->clue[c - 1];
+		size_t *row = &sc->fwd_count[c * stride];
+
+		for (size_t i = 0; i <= n; i++) {
+			row[i] = (i > 0 && !puzzle__line_is_set(line, i - 1)) ?
+					row[i - 1] : 0;
+			if (i >= len &&
+			    puzzle__range_unclear(sc, i - len, i)) {
+				row[i] = puzzle__sat_add(row[i],
+						puzzle__count_before(sc, line,
+							c - 1, i - len));
+			}
+		}
+	}
+
+	for (size_t c = k; c-- > 0;) {
+		size_t len = line->clue[c];
+		size_t *row = &sc->bwd_count[c * stride];
+
+		for (size_t i = n + 1; i-- > 0;) {
+			row[i] = (i < n && !puzzle__line_is_set(line, i)) ?
+					row[i + 1] : 0;
+			if (i + len <= n &&
+			    puzzle__range_unclear(sc, i, i + len)) {
+				row[i] = puzzle__sat_add(row[i],
+						puzzle__count_after(sc, line,
+								c, i + len));
+			}
+		}
+	}
+}
+
+/**
+ * Fill the prefix and suffix placement count tables for a line, as logs.
+ *
+ * Used for lines with too many placements to count in a size_t.
+ */
+static void puzzle__count_pack_log(
+		struct puzzle_scratch *sc,
+		const struct puzzle_line *line)
+{
+	size_t n = line->slot_count;
+	size_t k = line->clue_count;
+	size_t stride = n + 1;
+
+	for (size_t i = 0; i <= n; i++) {
+		sc->fwd_log[i] = puzzle__range_unset(sc, 0, i) ?
+				0 : -INFINITY;
+		sc->bwd_log[k * stride + i] =
+				puzzle__range_unset(sc, i, n) ?
+				0 : -INFINITY;
+	}
+
+	for (size_t c = 1; c <= k; c++) {
+		size_t len = line->clue[c - 1];
+		double *row = &sc->fwd_log[c * stride];
+
+		for (size_t i = 0; i <= n; i++) {
+			row[i] = (i > 0 && !puzzle__line_is_set(line, i - 1)) ?
+					row[i - 1] : -INFINITY;
+			if (i >= len &&
+			    puzzle__range_unclear(sc, i - len, i)) {
+				row[i] = puzzle__log_add(row[i],
+						puzzle__log_before(sc, line,
+							c - 1, i - len));
+			}
+		}
+	}
+
+	for (size_t c = k; c-- > 0;) {
+		size_t len = line->clue[c];
+		double *row = &sc->bwd_log[c * stride];
+
+		for (size_t i = n + 1; i-- > 0;) {
+			row[i] = (i < n && !puzzle__line_is_set(line, i)) ?
+					row[i + 1] : -INFINITY;
+			if (i + len <= n &&
+			    puzzle__range_unclear(sc, i, i + len)) {
+				row[i] = puzzle__log_add(row[i],
+						puzzle__log_after(sc, line,
+								c, i + len));
+			}
+		}
+	}
+}
+
+/**
+ * Set a line's slot counts to the number of placements covering each slot.
+ *
+ * This gives the same slot counts and slot_max as trying every placement of
+ * the clues, without trying them all. A slot's count is the total placement
+ * count, less the number of placements that leave it empty. Needs the slot
+ * prefix sums from \ref puzzle__overlap_pack.
+ */
+static void puzzle__overlap_count(
+		struct puzzle_scratch *sc,
+		struct puzzle_line *line)
+{
+	size_t n = line->slot_count;
+	size_t k = line->clue_count;
+	size_t stride = n + 1;
+	size_t total;
+	double total_log;
+
+	puzzle__count_pack(sc, line);
+	total = sc->fwd_count[k * stride + n];
+
+	if (total != SIZE_MAX) {
+		line->slot_max = puzzle__count_max(total);
+		for (size_t s = 0; s < n; s++) {
+			size_t empty = 0;
+
+			if (puzzle__slot_is_done(line, s)) {
+				continue;
+			}
+
+			for (size_t c = 0; c <= k; c++) {
+				size_t *fwd = &sc->fwd_count[c * stride];
+				size_t *bwd = &sc->bwd_count[c * stride];
+
+				empty = puzzle__sat_add(empty, puzzle__sat_mul(
+						fwd[s], bwd[s + 1]));
+			}
+			line->count[s] = puzzle__count_narrow(
+					total - empty, total);
+		}
+		return;
+	}
+
+	puzzle__count_pack_log(sc, line);
+	total_log = sc->fwd_log[k * stride + n];
+	line->slot_max = PUZZLE_COUNT_SCALE;
+
+	for (size_t s = 0; s < n; s++) {
+		double empty = 0;
+
+		if (puzzle__slot_is_done(line, s)) {
+			continue;
+		}
+
+		for (size_t c = 0; c <= k; c++) {
+			empty += exp(sc->fwd_log[c * stride + s] +
+			             sc->bwd_log[c * stride + s + 1] -
+			             total_log);
+		}
+		if (empty > 1) {
+			empty = 1;
+		}
+		line->count[s] = (uint32_t)((1 - empty) *
+				(double)PUZZLE_COUNT_SCALE + 0.5);
+	}
+}
+
+/**
+ * Solve a line from the overlap of all the places each clue can go.
+ *
+ * A clue's possible start positions lie between its left-most and right-most
+ * packing. A slot is set if no placement can leave it empty, and clear if no
+ * clue can cover it. This fixes the same slots as trying every placement of
+ * the clues, in O(slot_count * clue_count) time. Only the starts in each
+ * clue's range are tried.
+ */
+static bool puzzle__solve_line_overlap(
+		struct puzzle_scratch *sc,
+		struct puzzle_line *line)
+{
+	bool count = line->count != NULL;
+	size_t n = line->slot_count;
+	size_t k = line->clue_count;
+	size_t stride = n + 1;
+	size_t covered = 0;
+
+	puzzle__overlap_pack(sc, line);
+	if (!sc->fwd[k * stride + n]) {
+		return false;
+	}
+
+	if (count) {
+		puzzle__overlap_count(sc, line);
+	}
+
+	for (size_t s = 0; s <= n; s++) {
+		sc->cover[s] = 0;
+	}
+
+	for (size_t c = 0; c < k; c++) {
+		size_t len = line->clue[c];
+
+		sc->start_min[c] = SIZE_MAX;
+		sc->start_max[c] = 0;
+		for (size_t s = line->start_min[c];
+				s <= line->start_max[c] && s + len <= n; s++) {
+			if (puzzle__range_unclear(sc, s, s + len) &&
+			    puzzle__overlap_fits_before(sc, line, c, s) &&
+			    puzzle__overlap_fits_after(sc, line, c, s + len)) {
+				sc->cover[s]++;
+				sc->cover[s + len]--;
+				if (sc->start_min[c] == SIZE_MAX) {
+					sc->start_min[c] = s;
+				}
+				sc->start_max[c] = s;
+			}
+		}
+	}
+	puzzle__line_range_keep(sc, line);
+
+	for (size_t s = 0; s < n; s++) {
+		bool can_clear = false;
+
+		covered += sc->cover[s];
+		if (puzzle__slot_is_done(line, s)) {
+			continue;
+		}
+
+		for (size_t c = 0; c <= k; c++) {
+			if (sc->fwd[c * stride + s] &&
+			    sc->bwd[c * stride + s + 1]) {
+				can_clear = true;
+				break;
+			}
+		}
+
+		if (covered == 0) {
+			puzzle__line_slot_done(sc, line, s, false);
+		} else if (!can_clear) {
+			puzzle__line_slot_done(sc, line, s, true);
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Solve a line that has only one placement of its clues left.
+ *
+ * That is the case when the set slots already add up to the clues, so the
+ * unsolved slots must all be clear, or when the clear slots leave only
+ * room for the clues, so the unsolved slots must all be set. The line's
+ * runs must then match its clues.
+ *
+ * \param[in]  sc    Scratch space.
+ * \param[in]  line  The line to solve.
+ * \param[in]  set   Whether the unsolved slots must be set.
+ * 
+eturn true on success, or false if the clues can't be placed.
+ */
+static bool puzzle__solve_line_complete(
+		struct puzzle_scratch *sc,
+		struct puzzle_line *line,
+		bool set)
+{
+	enum puzzle_cell fill = set ? PUZZLE_CELL_SET : PUZZLE_CELL_CLEAR;
+	size_t clue = 0;
+	size_t run = 0;
+
+	for (size_t s = 0; s <= line->slot_count; s++) {
+		enum puzzle_cell state = PUZZLE_CELL_CLEAR;
+
+		if (s < line->slot_count) {
+			state = puzzle_line_get(line, s);
+			if (state == PUZZLE_CELL_UNKNOWN) {
+				state = fill;
+			}
+		}
+
+		if (state == PUZZLE_CELL_SET) {
+			run++;
+			continue;
+		}
+
+		if (run > 0) {
+			if (clue == line->clue_count ||
+			    line->clue[clue] != run) {
+				return false;
+			}
+			sc->start_min[clue] = s - run;
+			sc->start_max[clue] = s - run;
+			clue++;
+			run = 0;
+		}
+	}
+
+	if (clue != line->clue_count) {
+		return false;
+	}
+
+	puzzle__line_range_keep(sc, line);
+	if (line->count != NULL) {
+		line->slot_max = 1;
+	}
+
+	for (size_t s = 0; s < line->slot_count; s++) {
+		if (!puzzle__slot_is_done(line, s)) {
+			if (line->count != NULL) {
+				line->count[s] = set;
+			}
+			puzzle__line_slot_done(sc, line, s, set);
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Solve a line with the line solver that suits it best.
+ *
+ * Lines with only one placement left are completed directly. Short lines
+ * with few clues are solved by the enumerator, and the rest by the overlap
+ * solver, with the line lengths for the enumerator from the tuning.
+ */
+static bool puzzle__solve_line_auto(
+		const struct puzzle *p,
+		struct puzzle_scratch *sc,
+		struct puzzle_line *line)
+{
+	size_t n = line->slot_count;
+	size_t k = line->clue_count;
+	size_t set = 0;
+	size_t clear = 0;
+
+	for (size_t s = 0; s < n; s++) {
+		switch (puzzle_line_get(line, s)) {
+		case PUZZLE_CELL_SET:
+			set++;
+			break;
+		case PUZZLE_CELL_CLEAR:
+			clear++;
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (set == line->clue_total) {
+		return puzzle__solve_line_complete(sc, line, false);
+
+	} else if (clear + line->clue_total == n) {
+		return puzzle__solve_line_complete(sc, line, true);
+
+	} else if (k > 0 && k <= TUNE_CLUES &&
+			n <= p->tune->enumerate_slots[k - 1]) {
+		return puzzle__solve_line_enumerate(sc, line);
+	}
+
+	return puzzle__solve_line_overlap(sc, line);
+}
+
+static bool puzzle__line_solve_uncached(
+		const struct puzzle *p,
+		struct puzzle_scratch *sc,
+		struct puzzle_line *line)
+{
+	switch (p->options->line_solver) {
+	case PUZZLE_LINE_SOLVER_ENUMERATE:
+		return puzzle__solve_line_enumerate(sc, line);
+
+	case PUZZLE_LINE_SOLVER_AUTO:
+		return puzzle__solve_line_auto(p, sc, line);
+
+	default:
+		return puzzle__solve_line_overlap(sc, line);
+	}
+}
+
+/**
+ * Build the line cache key for a line.
+ *
+ * The key is the line length, the clues, and masks of the solved set and
+ * solved clear slots. Nothing else about the line affects a line solve.
+ *
+ * \param[in]  sc    Scratch space to build the key in.
+ * \param[in]  line  The line to build the key for.
+ * 
+eturn the number of words in the key.
+ */
+static size_t puzzle__line_cache_key(
+		struct puzzle_scratch *sc,
+		const struct puzzle_line *line)
+{
+	size_t words = bits_words(line->slot_count);
+	uint64_t *key = sc->cache_key;
+	uint64_t *set;
+	uint64_t *clear;
+	size_t count = 0;
+
+	key[count++] = line->slot_count;
+	key[count++] = line->clue_count;
+	for (size_t c = 0; c < line->clue_count; c++) {
+		key[count++] = line->clue[c];
+	}
+
+	set = &key[count];
+	clear = &key[count + words];
+	memset(set, 0, 2 * words * sizeof(*key));
+	for (size_t s = 0; s < line->slot_count; s++) {
+		switch (puzzle_line_get(line, s)) {
+		case PUZZLE_CELL_SET:
+			bits_set(set, s);
+			break;
+		case PUZZLE_CELL_CLEAR:
+			bits_set(clear, s);
+			break;
+		default:
+			break;
+		}
+	}
+
+	return count + 2 * words;
+}
+
+/**
+ * Solve a line from a line cache entry.
+ *
+ * The entry holds whether the line could be solved, the line's slot_max,
+ * masks of the slots solved set and solved clear, the clue start ranges,
+ * and, for the detail style, the counts of all the unsolved slots.
+ */
+static bool puzzle__line_cache_apply(
+		struct puzzle_scratch *sc,
+		struct puzzle_line *line,
+		const uint64_t *value)
+{
+	size_t words = bits_words(line->slot_count);
+	size_t k = line->clue_count;
+	const uint64_t *fixed_set = &value[2];
+	const uint64_t *fixed_clear = &value[2 + words];
+	const uint64_t *start = &value[2 + 2 * words];
+	const uint64_t *count = &value[2 + 2 * words + 2 * k];
+
+	if (value[0] != 0) {
+		for (size_t c = 0; c < k; c++) {
+			line->start_min[c] = (size_t)start[c];
+			line->start_max[c] = (size_t)start[k + c];
+		}
+	}
+
+	line->slot_max = (size_t)value[1];
+	for (size_t s = 0; s < line->slot_count; s++) {
+		if (puzzle__slot_is_done(line, s)) {
+			continue;
+		}
+
+		if (line->count != NULL) {
+			line->count[s] = (uint32_t)*count++;
+		}
+		if (bits_test(fixed_set, s)) {
+			puzzle__line_slot_done(sc, line, s, true);
+		} else if (bits_test(fixed_clear, s)) {
+			puzzle__line_slot_done(sc, line, s, false);
+		}
+	}
+
+	return value[0] != 0;
+}
+
+/**
+ * Solve a line, looking up the result in the line cache first.
+ *
+ * Rows and columns often meet the same clues with the same solved slots,
+ * both within a puzzle and, while searching or probing, on different
+ * branches.
+ */
+static bool puzzle__line_solve_cached(
+		const struct puzzle *p,
+		struct puzzle_scratch *sc,
+		struct puzzle_line *line)
+{
+	size_t words = bits_words(line->slot_count);
+	size_t key_len = puzzle__line_cache_key(sc, line);
+	uint64_t *value = sc->cache_value;
+	const uint64_t *found;
+	size_t value_len;
+	bool ok;
+
+	found = cache_find(sc->cache, sc->cache_key,
+			key_len * sizeof(*sc->cache_key), &value_len);
+	if (found != NULL) {
+		return puzzle__line_cache_apply(sc, line, found);
+	}
+
+	ok = puzzle__line_solve_uncached(p, sc, line);
+
+	value[0] = ok;
+	value[1] = line->slot_max;
+	memset(&value[2], 0, 2 * words * sizeof(*value));
+	for (size_t i = 0; i < sc->fixed_count; i++) {
+		size_t s = sc->fixed[i];
+
+		bits_set(&value[puzzle__line_is_set(line, s) ?
+				2 : 2 + words], s);
+	}
+
+	value_len = 2 + 2 * words;
+	for (size_t c = 0; c < line->clue_count; c++) {
+		value[value_len + c] = line->start_min[c];
+		value[value_len + line->clue_count + c] = line->start_max[c];
+	}
+
+	value_len += 2 * line->clue_count;
+	for (size_t s = 0; line->count != NULL &&
+			s < line->slot_count; s++) {
+		const uint64_t *key_set = &sc->cache_key[key_len - 2 * words];
+		const uint64_t *key_clear = &sc->cache_key[key_len - words];
+
+		if (!bits_test(key_set, s) && !bits_test(key_clear, s)) {
+			value[value_len++] = line->count[s];
+		}
+	}
+
+	/* The cache only saves time, so a failure to add is not an error. */
+	cache_insert(sc->cache, sc->cache_key,
+			key_len * sizeof(*sc->cache_key),
+			value, value_len * sizeof(*value));
+	return ok;
+}
+
+/**
+ * Get a view of a line without its solved ends.
+ *
+ * Solved slots at the start of a line, up to a clear slot, hold the line's
+ * first clues, if their runs of set slots match them. Those clues can't
+ * move, so their slots make no difference to solving the rest of the line.
+ * The same goes for the end of the line. The view is the unsolved middle
+ * of the line, with the clues that go there.
+ *
+ * The view shares the line's cell states and counts. Its clue start ranges
+ * and gap index are the line's, changed to be relative to the view until
+ * \ref puzzle__line_untrim. Packed line state is copied to the scratch
+ * space.
+ *
+ * \param[in]  sc    The scratch space.
+ * \param[in]  line  The line to trim.
+ * \param[out] trim  Returns the view of the line.
+ * \return the number of slots trimmed from the start of the line.
+ */
+static size_t puzzle__line_trim(
+		struct puzzle_scratch *sc,
+		struct puzzle_line *line,
+		struct puzzle_line *trim)
+{
+	size_t n = line->slot_count;
+	size_t k = line->clue_count;
+	size_t lo = 0;
+	size_t hi = n;
+	size_t clue_lo = 0;
+	size_t clue_hi = k;
+	size_t run = 0;
+	size_t c = 0;
+
+	for (size_t s = 0; s < n; s++) {
+		enum puzzle_cell state = puzzle_line_get(line, s);
+
+		if (state == PUZZLE_CELL_UNKNOWN) {
+			break;
+		} else if (state == PUZZLE_CELL_SET) {
+			run++;
+			continue;
+		}
+
+		if (run > 0) {
+			if (c == k || line->clue[c] != run) {
+				break;
+			}
+			line->start_min[c] = s - run;
+			line->start_max[c] = s - run;
+			run = 0;
+			c++;
+		}
+		lo = s + 1;
+		clue_lo = c;
+	}
+
+	run = 0;
+	c = k;
+	for (size_t s = n; s-- > lo;) {
+		enum puzzle_cell state = puzzle_line_get(line, s);
+
+		if (state == PUZZLE_CELL_UNKNOWN) {
+			break;
+		} else if (state == PUZZLE_CELL_SET) {
+			run++;
+			continue;
+		}
+
+		if (run > 0) {
+			if (c == clue_lo || line->clue[c - 1] != run) {
+				break;
+			}
+			c--;
+			line->start_min[c] = s + 1;
+			line->start_max[c] = s + 1;
+			run = 0;
+		}
+		hi = s;
+		clue_hi = c;
+	}
+
+	*trim = *line;
+	if (lo == 0 && hi == n) {
+		return 0;
+	}
+
+	trim->clue = line->clue + clue_lo;
+	trim->clue_count = clue_hi - clue_lo;
+	trim->cell_first = line->cell_first + lo * line->cell_step;
+	trim->slot_count = hi - lo;
+	trim->total = line->total - (n - trim->slot_count);
+	trim->start_min = line->start_min + clue_lo;
+	trim->start_max = line->start_max + clue_lo;
+	trim->clue_total = 0;
+	for (c = 0; c < trim->clue_count; c++) {
+		trim->clue_total += trim->clue[c];
+
+		/* The clues left can't start in the trimmed slots. */
+		trim->start_min[c] = (trim->start_min[c] > lo) ?
+				trim->start_min[c] - lo : 0;
+		trim->start_max[c] = (trim->start_max[c] > lo) ?
+				trim->start_max[c] - lo : 0;
+	}
+
+	if (line->count != NULL) {
+		trim->count = line->count + lo;
+	}
+	if (line->known_set != NULL) {
+		trim->known_set = sc->trim_set;
+		trim->known_clear = sc->trim_clear;
+		bits_extract(trim->known_set, line->known_set, lo, hi);
+		bits_extract(trim->known_clear, line->known_clear, lo, hi);
+	}
+	if (line->clear_next != NULL) {
+		trim->clear_next = line->clear_next + lo;
+		for (size_t s = 0; s < trim->slot_count; s++) {
+			trim->clear_next[s] -= (uint32_t)lo;
+		}
+	}
+
+	return lo;
+}
+
+/**
+ * Update a line from a solve of its trimmed view.
+ *
+ * The solved slots listed in the scratch space are changed to be slots of
+ * the line.
+ *
+ * \param[in]  sc    The scratch space.
+ * \param[in]  line  The line that was trimmed.
+ * \param[in]  trim  The solved view of the line.
+ * \param[in]  lo    Number of slots trimmed from the start of the line.
+ */
+static void puzzle__line_untrim(
+		struct puzzle_scratch *sc,
+		struct puzzle_line *line,
+		const struct puzzle_line *trim,
+		size_t lo)
+{
+	for (size_t c = 0; c < trim->clue_count; c++) {
+		trim->start_min[c] += lo;
+		trim->start_max[c] += lo;
+	}
+
+	if (line->clear_next != NULL) {
+		for (size_t s = 0; s < trim->slot_count; s++) {
+			trim->clear_next[s] += (uint32_t)lo;
+		}
+	}
+
+	for (size_t i = 0; i < sc->fixed_count; i++) {
+		size_t s = sc->fixed[i] + lo;
+
+		if (line->known_set != NULL) {
+			if (puzzle_line_get(line, s) == PUZZLE_CELL_SET) {
+				bits_set(line->known_set, s);
+			} else {
+				bits_set(line->known_clear, s);
+			}
+		}
+		sc->fixed[i] = s;
+	}
+
+	line->total += sc->fixed_count;
+	line->slot_max = trim->slot_max;
+}
+
+/**
+ * Solve a line, without updating the crossing lines.
+ *
+ * Only the line's unsolved middle is solved, once its solved ends are
+ * trimmed off. The solved slots are listed in the scratch space.
+ */
+static bool puzzle__line_solve(
+		const struct puzzle *p,
+		struct puzzle_scratch *sc,
+		struct puzzle_line *line)
+{
+	struct puzzle_line trim;
+	struct puzzle_line *solve = line;
+	size_t lo;
+	bool ok;
+
+	sc->fixed_count = 0;
+
+	lo = puzzle__line_trim(sc, line, &trim);
+	if (trim.slot_count != line->slot_count) {
+		solve = &trim;
+	}
+
+	if (sc->cache != NULL) {
+		ok = puzzle__line_solve_cached(p, sc, solve);
+	} else {
+		ok = puzzle__line_solve_uncached(p, sc, solve);
+	}
+
+	if (solve == &trim) {
+		puzzle__line_untrim(sc, line, &trim, lo);
+	}
+
+	return ok;
+}
+
+/**
+ * Raise a solver event, unless the puzzle is a probing copy.
+ */
+static inline void puzzle__notify(
+		struct puzzle *p,
+		enum output_event event)
+{
+	if (!p->probing) {
+		if (event == OUTPUT_EVENT_PASS) {
+			p->pass_count++;
+		}
+		if (p->event_fn != NULL) {
+			p->event_fn(p->event_pw, event);
+		}
+	}
+}
+
+/**
+ * Update the crossing lines for the slots solved by a line solve.
+ */
+static void puzzle__line_apply(
+		struct puzzle *p,
+		struct puzzle_line *lines,
+		size_t line_idx,
+		const size_t *fixed,
+		size_t fixed_count)
+{
+	struct puzzle_line *line = &lines[line_idx];
+
+	if (line->count != NULL) {
+		puzzle__changed_line(p, lines, line_idx);
+	}
+
+	for (size_t i = 0; i < fixed_count; i++) {
+		puzzle__solve_slot_done(p, lines, line_idx, fixed[i]);
+	}
+
+	line->update_needed = false;
+	line->fresh = 0;
+	puzzle__notify(p, OUTPUT_EVENT_LINE);
+}
+
+/**
+ * Check whether a line needs to be solved.
+ *
+ * Once the search has made a guess, or while probing, complete lines are
+ * solved too, as crossing lines may have filled them in a way that breaks
+ * their clues.
+ */
+static inline bool puzzle__line_wanted(
+		const struct puzzle *p,
+		const struct puzzle_line *line)
+{
+	if (line->total == line->slot_count &&
+	    p->guess_count == 0 && !p->probing) {
+		return false;
+	}
+
+	return line->update_needed;
+}
+
+static bool puzzle__solve_line(
+		struct puzzle *p,
+		struct puzzle_line *lines,
+		size_t line_idx)
+{
+	struct puzzle_scratch *sc = &p->scratch[0];
+
+	if (!puzzle__line_solve(p, sc, &lines[line_idx])) {
+		/* The line solvers may have left new placement counts. */
+		if (lines[line_idx].count != NULL) {
+			puzzle__changed_line(p, lines, line_idx);
+		}
+		return false;
+	}
+
+	puzzle__line_apply(p, lines, line_idx, sc->fixed, sc->fixed_count);
+	return true;
+}
+
+/**
+ * Hash a line's clues and cell states, with FNV-1a.
+ */
+static uint64_t puzzle__line_hash(const struct puzzle_line *line)
+{
+	uint64_t hash = 0xcbf29ce484222325;
+
+	hash = (hash ^ line->slot_count) * 0x100000001b3;
+	for (size_t c = 0; c < line->clue_count; c++) {
+		hash = (hash ^ line->clue[c]) * 0x100000001b3;
+	}
+	for (size_t s = 0; s < line->slot_count; s++) {
+		hash = (hash ^ puzzle_line_get(line, s)) * 0x100000001b3;
+	}
+
+	return hash;
+}
+
+/**
+ * Check whether two lines have the same clues and cell states.
+ */
+static bool puzzle__line_same(
+		const struct puzzle_line *a,
+		const struct puzzle_line *b)
+{
+	if (a->slot_count != b->slot_count ||
+	    a->clue_count != b->clue_count) {
+		return false;
+	}
+
+	for (size_t c = 0; c < a->clue_count; c++) {
+		if (a->clue[c] != b->clue[c]) {
+			return false;
+		}
+	}
+	for (size_t s = 0; s < a->slot_count; s++) {
+		if (puzzle_line_get(a, s) != puzzle_line_get(b, s)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Group the lines wanted by a pass that have the same clues and cell states.
+ *
+ * Lines of a pass don't change each other, so a line that is the same as
+ * an earlier line of the pass at the start of the pass is still the same
+ * when its turn comes, and has the same solve.
+ *
+ * \param[in]  p           The puzzle.
+ * \param[in]  lines       The lines of the pass.
+ * \param[in]  line_count  Number of entries in lines.
+ * 
+eturn for each line, the index of the first line it is the same as,
+ *         which is its own index for the first of each group and the lines
+ *         that aren't wanted, or NULL if line dedupe is off.
+ */
+static const size_t *puzzle__line_groups(
+		struct puzzle *p,
+		struct puzzle_line *lines,
+		size_t line_count)
+{
+	struct puzzle_scratch *sc = &p->scratch[0];
+	size_t *table = sc->group_table;
+
+	if (sc->group == NULL) {
+		return NULL;
+	}
+
+	for (size_t b = 0; b <= sc->group_mask; b++) {
+		table[b] = SIZE_MAX;
+	}
+
+	for (size_t i = 0; i < line_count; i++) {
+		size_t b;
+
+		sc->group[i] = i;
+		if (!puzzle__line_wanted(p, &lines[i])) {
+			continue;
+		}
+
+		b = puzzle__line_hash(&lines[i]) & sc->group_mask;
+		while (table[b] != SIZE_MAX) {
+			if (puzzle__line_same(&lines[table[b]], &lines[i])) {
+				sc->group[i] = table[b];
+				break;
+			}
+			b = (b + 1) & sc->group_mask;
+		}
+
+		if (sc->group[i] == i) {
+			table[b] = i;
+			sc->group_solves++;
+		}
+		sc->group_lines++;
+	}
+
+	return sc->group;
+}
+
+/**
+ * Solve a line by copying the solve of an identical line of the pass.
+ */
+static void puzzle__solve_line_copy(
+		struct puzzle *p,
+		struct puzzle_line *lines,
+		size_t line_idx,
+		size_t from_idx)
+{
+	struct puzzle_scratch *sc = &p->scratch[0];
+	struct puzzle_line *line = &lines[line_idx];
+	const struct puzzle_line *from = &lines[from_idx];
+
+	sc->fixed_count = 0;
+	for (size_t s = 0; s < line->slot_count; s++) {
+		if (puzzle__slot_is_done(line, s)) {
+			continue;
+		}
+
+		if (puzzle__slot_is_done(from, s)) {
+			puzzle__line_slot_done(sc, line, s,
+					puzzle_line_get(from, s) ==
+					PUZZLE_CELL_SET);
+		} else if (line->count != NULL) {
+			line->count[s] = from->count[s];
+		}
+	}
+
+	memcpy(line->start_min, from->start_min,
+			line->clue_count * sizeof(*line->start_min));
+	memcpy(line->start_max, from->start_max,
+			line->clue_count * sizeof(*line->start_max));
+	line->slot_max = from->slot_max;
+
+	puzzle__line_apply(p, lines, line_idx, sc->fixed, sc->fixed_count);
+}
+
+static bool puzzle__solve_pass_serial(
+		struct puzzle *p,
+		struct puzzle_line *lines,
+		size_t line_count,
+		const size_t *group)
+{
+	for (size_t i = 0; i < line_count; i++) {
+		if (!puzzle__line_wanted(p, &lines[i])) {
+			continue;
+		}
+		if (group != NULL && group[i] != i) {
+			puzzle__solve_line_copy(p, lines, i, group[i]);
+			continue;
+		}
+		if (!puzzle__solve_line(p, lines, i)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Worker thread callback to solve a line on a copy of the line.
+ *
+ * The copy's cell states are its own, as neighbouring cells of different
+ * lines can share a byte of the puzzle's packed cell states.
+ */
+static void puzzle__job_run(void *pw, size_t index, size_t thread)
+{
+	struct puzzle *p = pw;
+	struct puzzle_job *job = &p->job[index];
+	struct puzzle_scratch *sc = &p->scratch[thread];
+	const struct puzzle_line *line = &job->lines[job->line_idx];
+	size_t words = bits_words(line->slot_count);
+
+	job->line = *line;
+	job->line.cell = job->cell;
+	job->line.cell_first = 0;
+	job->line.cell_step = 1;
+	for (size_t s = 0; s < line->slot_count; s++) {
+		puzzle__cell_put(job->cell, s, puzzle_line_get(line, s));
+	}
+	if (line->count != NULL) {
+		job->line.count = job->count;
+		memcpy(job->count, line->count,
+				line->slot_count * sizeof(*job->count));
+	}
+	if (line->known_set != NULL) {
+		job->line.known_set = job->known_set;
+		job->line.known_clear = job->known_clear;
+		memcpy(job->known_set, line->known_set,
+				words * sizeof(*job->known_set));
+		memcpy(job->known_clear, line->known_clear,
+				words * sizeof(*job->known_clear));
+	}
+	if (line->clear_next != NULL) {
+		job->line.clear_next = job->clear_next;
+		memcpy(job->clear_next, line->clear_next,
+				line->slot_count * sizeof(*job->clear_next));
+	}
+	job->line.start_min = job->start_min;
+	job->line.start_max = job->start_max;
+	memcpy(job->start_min, line->start_min,
+			line->clue_count * sizeof(*job->start_min));
+	memcpy(job->start_max, line->start_max,
+			line->clue_count * sizeof(*job->start_max));
+
+	job->ok = puzzle__line_solve(p, sc, &job->line);
+
+	memcpy(job->fixed, sc->fixed, sc->fixed_count * sizeof(*job->fixed));
+	job->fixed_count = sc->fixed_count;
+}
+
+/**
+ * Copy a finished job's working line back, and update the crossing lines.
+ */
+static void puzzle__job_merge(
+		struct puzzle *p,
+		const struct puzzle_job *job)
+{
+	struct puzzle_line *line = &job->lines[job->line_idx];
+	size_t words = bits_words(line->slot_count);
+
+	for (size_t i = 0; i < job->fixed_count; i++) {
+		size_t s = job->fixed[i];
+
+		puzzle__line_put(line, s, puzzle_line_get(&job->line, s));
+	}
+	if (line->count != NULL) {
+		memcpy(line->count, job->count,
+				line->slot_count * sizeof(*job->count));
+	}
+	if (line->known_set != NULL) {
+		memcpy(line->known_set, job->known_set,
+				words * sizeof(*job->known_set));
+		memcpy(line->known_clear, job->known_clear,
+				words * sizeof(*job->known_clear));
+	}
+	if (line->clear_next != NULL) {
+		memcpy(line->clear_next, job->clear_next,
+				line->slot_count * sizeof(*job->clear_next));
+	}
+	memcpy(line->start_min, job->start_min,
+			line->clue_count * sizeof(*job->start_min));
+	memcpy(line->start_max, job->start_max,
+			line->clue_count * sizeof(*job->start_max));
+	line->slot_max = job->line.slot_max;
+	line->total = job->line.total;
+
+	puzzle__line_apply(p, job->lines, job->line_idx,
+			job->fixed, job->fixed_count);
+}
+
+/**
+ * Solve the lines of a pass on the worker threads.
+ *
+ * Lines in the same pass only write slots of their own and the crossing
+ * lines, and never read the crossing lines. So they can be solved at the
+ * same time, as long as the crossing lines are updated afterwards. The
+ * results are merged in line order, so the outcome and the line events
+ * are the same as for a single thread.
+ */
+static bool puzzle__solve_pass_threaded(
+		struct puzzle *p,
+		struct puzzle_line *lines,
+		size_t line_count,
+		const size_t *group)
+{
+	size_t i = 0;
+
+	while (i < line_count) {
+		size_t first = i;
+		size_t count = 0;
+		size_t j = 0;
+
+		for (; i < line_count && count < p->job_count; i++) {
+			if (!puzzle__line_wanted(p, &lines[i]) ||
+			    (group != NULL && group[i] != i)) {
+				continue;
+			}
+			p->job[count].lines = lines;
+			p->job[count].line_idx = i;
+			count++;
+		}
+
+		pool_run(p->pool, count, puzzle__job_run, p);
+
+		for (size_t l = first; l < i; l++) {
+			if (j < count && p->job[j].line_idx == l) {
+				if (!p->job[j].ok) {
+					return false;
+				}
+				puzzle__job_merge(p, &p->job[j++]);
+			} else if (group != NULL && group[l] != l) {
+				puzzle__solve_line_copy(p, lines, l, group[l]);
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool puzzle__solve_pass(
+		struct puzzle *p,
+		struct puzzle_line *lines,
+		size_t line_count)
+{
+	const size_t *group = puzzle__line_groups(p, lines, line_count);
+	bool ok;
+
+	if (p->pool != NULL) {
+		ok = puzzle__solve_pass_threaded(p, lines, line_count, group);
+	} else {
+		ok = puzzle__solve_pass_serial(p, lines, line_count, group);
+	}
+
+	if (!ok) {
+		return false;
+	}
+
+	puzzle__notify(p, OUTPUT_EVENT_PASS);
+	return true;
+}
+
+void puzzle_set_event_fn(
+		struct puzzle *p,
+		puzzle_event_fn fn,
+		void *pw)
+{
+	p->event_fn = fn;
+	p->event_pw = pw;
+}
+
+bool puzzle_is_complete(const struct puzzle *p)
+{
+	return p->cells_complete == p->col_count * p->row_count;
+}
+
+/** Outcome of solving lines until no more progress is made. */
+enum puzzle__state {
+	PUZZLE__STATE_SOLVED,        // Every cell is solved.
+	PUZZLE__STATE_STALLED,       // No line solve can solve more cells.
+	PUZZLE__STATE_CONTRADICTION, // A line's clues can't be placed.
+};
+
+static enum puzzle__state puzzle__solve_passes(struct puzzle *p)
+{
+	size_t cells_complete = 0;
+	int pass = 0;
+
+	while (!puzzle_is_complete(p)) {
+		bool vertical = pass & 0x1;
+		struct puzzle_line *lines = vertical ? p->col : p->row;
+		size_t line_count = vertical ? p->col_count : p->row_count;
+		bool ok;
+
+		if (vertical) {
+			puzzle__col_shadow(p, true);
+		}
+		ok = puzzle__solve_pass(p, lines, line_count);
+		if (vertical) {
+			puzzle__col_shadow(p, false);
+		}
+
+		if (!ok) {
+			return PUZZLE__STATE_CONTRADICTION;
+		}
+
+		if (vertical) {
+			if (cells_complete == p->cells_complete) {
+				return PUZZLE__STATE_STALLED;
+			}
+
+			cells_complete = p->cells_complete;
+		}
+
+		pass++;
+	}
+
+	return PUZZLE__STATE_SOLVED;
+}
+
+/**
+ * Solve the puzzle from a work queue of lines.
+ *
+ * Solving a slot queues the crossing line. Each pass event is raised once
+ * as many lines have been taken from the queue as it held at the start of
+ * the pass.
+ */
+static enum puzzle__state puzzle__solve_queue(struct puzzle *p)
+{
+	size_t pass_left = p->queue_count;
+	size_t pass_done = 0;
+
+	while (p->queue_count > 0 && !puzzle_is_complete(p)) {
+		size_t line_idx;
+		size_t id = puzzle__queue_pop(p);
+		struct puzzle_line *lines = puzzle__queue_lines(p, id,
+				&line_idx);
+
+		if (puzzle__line_wanted(p, &lines[line_idx])) {
+			if (!puzzle__solve_line(p, lines, line_idx)) {
+				return PUZZLE__STATE_CONTRADICTION;
+			}
+		}
+
+		pass_done++;
+		if (--pass_left == 0) {
+			puzzle__notify(p, OUTPUT_EVENT_PASS);
+			pass_left = p->queue_count;
+			pass_done = 0;
+		}
+	}
+
+	if (pass_done > 0) {
+		puzzle__notify(p, OUTPUT_EVENT_PASS);
+	}
+
+	if (!puzzle_is_complete(p)) {
+		return PUZZLE__STATE_STALLED;
+	}
+
+	return PUZZLE__STATE_SOLVED;
+}
+
+/**
+ * Solve lines until the puzzle is solved or no more progress is made.
+ */
+static enum puzzle__state puzzle__propagate(struct puzzle *p)
+{
+	switch (p->options->scheduler) {
+	case PUZZLE_SCHEDULER_QUEUE:
+		return puzzle__solve_queue(p);
+
+	default:
+		return puzzle__solve_passes(p);
+	}
+}
+
+/**
+ * Check that the set slots on a complete line match its clues.
+ */
+static bool puzzle__line_check(const struct puzzle_line *line)
+{
+	size_t clue = 0;
+	size_t run = 0;
+
+	for (size_t s = 0; s <= line->slot_count; s++) {
+		if (s < line->slot_count &&
+		    puzzle_line_get(line, s) == PUZZLE_CELL_SET) {
+			run++;
+			continue;
+		}
+
+		if (run > 0) {
+			if (clue == line->clue_count ||
+			    line->clue[clue] != run) {
+				return false;
+			}
+			clue++;
+			run = 0;
+		}
+	}
+
+	return clue == line->clue_count;
+}
+
+/**
+ * Check that every line of a complete puzzle matches its clues.
+ *
+ * A guess can complete a line from the crossing lines without the line
+ * itself being solved again, so a solved state must be checked.
+ */
+static bool puzzle__check(const struct puzzle *p)
+{
+	for (size_t r = 0; r < p->row_count; r++) {
+		if (!puzzle__line_check(&p->row[r])) {
+			return false;
+		}
+	}
+
+	for (size_t c = 0; c < p->col_count; c++) {
+		if (!puzzle__line_check(&p->col[c])) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Mark a slot on a line as unsolved again.
+ */
+static void puzzle__line_slot_undo(
+		struct puzzle_line *line,
+		size_t slot_idx)
+{
+	puzzle__line_put(line, slot_idx, PUZZLE_CELL_UNKNOWN);
+	if (line->count != NULL) {
+		line->count[slot_idx] = 0;
+	}
+	line->total--;
+	line->update_needed = true;
+
+	if (line->known_set != NULL) {
+		bits_clear(line->known_set, slot_idx);
+		bits_clear(line->known_clear, slot_idx);
+	}
+
+	puzzle__line_gap_update(line, slot_idx);
+	puzzle__line_range_reset(line);
+}
+
+/**
+ * Unsolve the cells solved since the trail had the given length.
+ *
+ * The state at the mark was a fixed point of the line solvers, so only
+ * the lines of cells solved after it need to be solved again.
+ */
+static void puzzle__undo(struct puzzle *p, size_t trail_mark)
+{
+	while (p->trail_count > trail_mark) {
+		size_t cell = p->trail[--p->trail_count];
+		size_t r = cell / p->col_count;
+		size_t c = cell % p->col_count;
+
+		puzzle__line_slot_undo(&p->row[r], c);
+		puzzle__line_slot_undo(&p->col[c], r);
+		puzzle__tile_dirty(p, r, c);
+		puzzle__changed(p, r, c);
+		p->cells_complete--;
+	}
+
+	if (p->queue != NULL) {
+		while (p->queue_count > 0) {
+			puzzle__queue_pop(p);
+		}
+	}
+}
+
+/**
+ * Pick the unsolved cell to guess.
+ *
+ * The cell with the fewest unsolved cells on its row and column is
+ * chosen, as a guess there is most likely to lead to further progress
+ * or to a quick contradiction.
+ */
+static void puzzle__search_pick(
+		const struct puzzle *p,
+		struct puzzle_guess *g)
+{
+	size_t best = SIZE_MAX;
+
+	for (size_t r = 0; r < p->row_count; r++) {
+		const struct puzzle_line *row = &p->row[r];
+		size_t row_left = row->slot_count - row->total;
+
+		if (row_left == 0 || row_left >= best) {
+			continue;
+		}
+
+		for (size_t c = 0; c < p->col_count; c++) {
+			const struct puzzle_line *col = &p->col[c];
+			size_t left = row_left + col->slot_count - col->total;
+
+			if (left < best && !puzzle__slot_is_done(row, c)) {
+				best = left;
+				g->row = r;
+				g->col = c;
+			}
+		}
+	}
+}
+
+/**
+ * Solve the cell of a guess to the guessed value.
+ */
+static void puzzle__solve_cell(
+		struct puzzle *p,
+		const struct puzzle_guess *g)
+{
+	struct puzzle_scratch *sc = &p->scratch[0];
+	struct puzzle_line *line = &p->row[g->row];
+
+	sc->fixed_count = 0;
+	puzzle__line_slot_done(sc, line, g->col, g->set);
+	puzzle__solve_slot_done(p, p->row, g->row, g->col);
+
+	line->update_needed = true;
+	if (p->queue != NULL) {
+		puzzle__queue_push(p, g->row);
+	}
+}
+
+static void puzzle__search_guess(
+		struct puzzle *p,
+		const struct puzzle_guess *g)
+{
+	puzzle__solve_cell(p, g);
+	puzzle__notify(p, OUTPUT_EVENT_GUESS);
+}
+
+/** Probe: A cell was found to need to be clear. */
+#define PUZZLE_PROBE_CLEAR 0x1
+/** Probe: A cell was found to need to be set. */
+#define PUZZLE_PROBE_SET 0x2
+
+/**
+ * Refresh a probing copy of the puzzle from the puzzle.
+ *
+ * The puzzle must have stalled, so no line of the copy needs solving.
+ */
+static void puzzle__probe_sync(
+		const struct puzzle *p,
+		struct puzzle_probe *pr)
+{
+	struct puzzle *q = &pr->copy;
+	size_t line_count = p->row_count + p->col_count;
+	size_t cell_bytes = p->row_count * p->col_count / 4 + 1;
+
+	for (size_t id = 0; id < line_count; id++) {
+		size_t line_idx;
+		const struct puzzle_line *line = puzzle__queue_lines(p, id,
+				&line_idx) + line_idx;
+		struct puzzle_line *copy = puzzle__queue_lines(q, id,
+				&line_idx) + line_idx;
+
+		if (line->known_set != NULL) {
+			size_t words = bits_words(line->slot_count);
+
+			memcpy(copy->known_set, line->known_set,
+					words * sizeof(uint64_t));
+			memcpy(copy->known_clear, line->known_clear,
+					words * sizeof(uint64_t));
+		}
+		if (line->clear_next != NULL) {
+			memcpy(copy->clear_next, line->clear_next,
+					line->slot_count *
+					sizeof(*line->clear_next));
+		}
+		memcpy(copy->start_min, line->start_min,
+				line->clue_count * sizeof(*line->start_min));
+		memcpy(copy->start_max, line->start_max,
+				line->clue_count * sizeof(*line->start_max));
+		copy->total = line->total;
+		copy->slot_max = line->slot_max;
+		copy->update_needed = false;
+		copy->fresh = 0;
+		copy->queue_pos = SIZE_MAX;
+	}
+
+	memcpy(q->cell, p->cell, cell_bytes);
+	if (p->cell_col != NULL) {
+		memcpy(q->cell_col, p->cell_col, cell_bytes);
+		memcpy(q->tile_dirty, p->tile_dirty,
+				bits_words(puzzle__tile_count(p)) *
+				sizeof(*q->tile_dirty));
+	}
+	q->cells_complete = p->cells_complete;
+	q->trail_count = 0;
+	q->queue_count = 0;
+	pr->contradiction = false;
+}
+
+/**
+ * Record the cells solved by a probe that didn't lead to a contradiction.
+ *
+ * Cells solved by probing set are stamped with their value. Cells solved
+ * by probing clear that match are found.
+ */
+static void puzzle__probe_record(
+		struct puzzle_probe *pr,
+		size_t trail_mark,
+		bool set,
+		size_t stamp)
+{
+	const struct puzzle *q = &pr->copy;
+
+	for (size_t t = trail_mark; t < q->trail_count; t++) {
+		size_t cell = q->trail[t];
+		size_t r = cell / q->col_count;
+		size_t c = cell % q->col_count;
+		size_t value = puzzle__line_is_set(&q->row[r], c) ? 1 : 0;
+
+		if (set) {
+			pr->seen[cell] = stamp * 2 + value;
+		} else if (pr->seen[cell] == stamp * 2 + value) {
+			pr->fix[cell] |= value ? PUZZLE_PROBE_SET :
+					PUZZLE_PROBE_CLEAR;
+		}
+	}
+}
+
+/**
+ * Worker thread callback to probe a cell on the thread's puzzle copy.
+ *
+ * The cell is solved as set, and then as clear, and each is propagated
+ * and undone again. If only one value leads to a contradiction, the cell
+ * needs the other value. Otherwise, any cell solved the same way by both
+ * needs that value.
+ */
+static void puzzle__probe_run(void *pw, size_t index, size_t thread)
+{
+	struct puzzle *p = pw;
+	struct puzzle_probe *pr = &p->probe[thread];
+	struct puzzle *q = &pr->copy;
+	size_t cell = p->probe_cell[index];
+	size_t stamp = ++pr->stamp;
+	struct puzzle_guess g = {
+		.trail_mark = q->trail_count,
+		.row = cell / p->col_count,
+		.col = cell % p->col_count,
+	};
+	bool failed[2];
+
+	for (size_t i = 0; i < 2; i++) {
+		size_t v = 1 - i; /* Set first, then clear. */
+		enum puzzle__state state;
+
+		g.set = (v == 1);
+		puzzle__solve_cell(q, &g);
+		state = puzzle__propagate(q);
+		if (state == PUZZLE__STATE_SOLVED && !puzzle__check(q)) {
+			state = PUZZLE__STATE_CONTRADICTION;
+		}
+
+		failed[v] = (state == PUZZLE__STATE_CONTRADICTION);
+		if (!failed[v]) {
+			puzzle__probe_record(pr, g.trail_mark, g.set, stamp);
+		}
+
+		puzzle__undo(q, g.trail_mark);
+	}
+
+	if (failed[0] && failed[1]) {
+		pr->contradiction = true;
+	} else if (failed[0]) {
+		pr->fix[cell] |= PUZZLE_PROBE_SET;
+	} else if (failed[1]) {
+		pr->fix[cell] |= PUZZLE_PROBE_CLEAR;
+	}
+}
+
+/**
+ * Solve a stalled puzzle by probing each unsolved cell.
+ *
+ * Every probe in a round starts from the same state, so the cells found
+ * don't depend on which thread probed which cell. They are solved in cell
+ * order once all the probes have finished, and propagated. Rounds repeat
+ * until one finds nothing.
+ */
+static enum puzzle__state puzzle__probe(struct puzzle *p)
+{
+	size_t cells = p->row_count * p->col_count;
+
+	while (true) {
+		enum puzzle__state state;
+		size_t found = 0;
+
+		p->probe_cell_count = 0;
+		for (size_t c = 0; c < cells; c++) {
+			if (puzzle_cell_get(p->cell, c) == PUZZLE_CELL_UNKNOWN) {
+				p->probe_cell[p->probe_cell_count++] = c;
+			}
+		}
+
+		for (size_t t = 0; t < p->thread_count; t++) {
+			puzzle__probe_sync(p, &p->probe[t]);
+		}
+
+		if (p->pool != NULL) {
+			pool_run(p->pool, p->probe_cell_count,
+					puzzle__probe_run, p);
+		} else {
+			for (size_t i = 0; i < p->probe_cell_count; i++) {
+				puzzle__probe_run(p, i, 0);
+			}
+		}
+
+		for (size_t t = 0; t < p->thread_count; t++) {
+			if (p->probe[t].contradiction) {
+				return PUZZLE__STATE_CONTRADICTION;
+			}
+		}
+
+		for (size_t c = 0; c < cells; c++) {
+			uint8_t fix = 0;
+
+			for (size_t t = 0; t < p->thread_count; t++) {
+				fix |= p->probe[t].fix[c];
+				p->probe[t].fix[c] = 0;
+			}
+
+			if (fix == (PUZZLE_PROBE_SET | PUZZLE_PROBE_CLEAR)) {
+				return PUZZLE__STATE_CONTRADICTION;
+			} else if (fix != 0) {
+				struct puzzle_guess g = {
+					.row = c / p->col_count,
+					.col = c % p->col_count,
+					.set = (fix == PUZZLE_PROBE_SET),
+				};
+				puzzle__solve_cell(p, &g);
+				found++;
+			}
+		}
+
+		if (found == 0) {
+			return PUZZLE__STATE_STALLED;
+		}
+
+		state = puzzle__propagate(p);
+		if (state == PUZZLE__STATE_SOLVED && !puzzle__check(p)) {
+			return PUZZLE__STATE_CONTRADICTION;
+		} else if (state != PUZZLE__STATE_STALLED) {
+			return state;
+		}
+	}
+}
+
+/**
+ * Keep the cell values of a solved puzzle.
+ */
+static void puzzle__solution_save(struct puzzle *p)
+{
+	for (size_t r = 0; r < p->row_count; r++) {
+		for (size_t c = 0; c < p->col_count; c++) {
+			p->solution[r * p->col_count + c] =
+					puzzle__line_is_set(&p->row[r], c);
+		}
+	}
+}
+
+/**
+ * Solve the unsolved cells of the puzzle from the kept solution.
+ *
+ * The rows are filled in one at a time, like line solves.
+ */
+static void puzzle__solution_apply(struct puzzle *p)
+{
+	struct puzzle_scratch *sc = &p->scratch[0];
+
+	for (size_t r = 0; r < p->row_count; r++) {
+		struct puzzle_line *line = &p->row[r];
+
+		sc->fixed_count = 0;
+		for (size_t c = 0; c < line->slot_count; c++) {
+			if (!puzzle__slot_is_done(line, c)) {
+				puzzle__line_slot_done(sc, line, c,
+					p->solution[r * p->col_count + c]);
+			}
+		}
+
+		if (sc->fixed_count > 0) {
+			puzzle__line_apply(p, p->row, r,
+					sc->fixed, sc->fixed_count);
+		}
+	}
+
+	puzzle__notify(p, OUTPUT_EVENT_PASS);
+}
+
+/**
+ * Solve a stalled puzzle by guessing cells and backtracking.
+ *
+ * Each guess records the length of the trail of solved cells, so that
+ * backtracking only unsolves the cells solved since the guess. A cell is
+ * guessed set first, and then clear if that leads to a contradiction.
+ *
+ * Solutions are counted until the limit is reached. Further solutions are
+ * looked for by backtracking from each solution as if it was a
+ * contradiction. If the search ends before the limit, the first solution
+ * is filled back in.
+ *
+ * \param[in]  p      The puzzle.
+ * \param[in]  limit  Number of solutions to stop at.
+ * 
+eturn the state of the puzzle after the search.
+ */
+static enum puzzle__state puzzle__search(struct puzzle *p, size_t limit)
+{
+	enum puzzle__state state = PUZZLE__STATE_STALLED;
+	size_t stall_mark = p->trail_count;
+
+	while (true) {
+		if (state == PUZZLE__STATE_SOLVED && !puzzle__check(p)) {
+			state = PUZZLE__STATE_CONTRADICTION;
+		}
+
+		if (state == PUZZLE__STATE_SOLVED) {
+			if (p->solution_count++ == 0) {
+				puzzle__solution_save(p);
+			}
+			if (p->solution_count >= limit) {
+				return state;
+			}
+			state = PUZZLE__STATE_CONTRADICTION;
+		}
+
+		if (state == PUZZLE__STATE_STALLED) {
+			struct puzzle_guess *g = &p->guess[p->guess_count++];
+
+			puzzle__search_pick(p, g);
+			g->trail_mark = p->trail_count;
+			g->set = true;
+			puzzle__search_guess(p, g);
+
+		} else {
+			struct puzzle_guess *g;
+
+			while (p->guess_count > 0 &&
+			       !p->guess[p->guess_count - 1].set) {
+				p->guess_count--;
+			}
+			if (p->guess_count == 0) {
+				puzzle__undo(p, stall_mark);
+				if (p->solution_count == 0) {
+					return state;
+				}
+				puzzle__solution_apply(p);
+				return PUZZLE__STATE_SOLVED;
+			}
+
+			g = &p->guess[p->guess_count - 1];
+			puzzle__undo(p, g->trail_mark);
+			g->set = false;
+			puzzle__search_guess(p, g);
+		}
+
+		state = puzzle__propagate(p);
+	}
+}
+
+/**
+ * Get the pattern a line's slots must match, for the SAT encoding.
+ *
+ * The pattern is the slots of each clue, with one clear slot between
+ * clues. Any number of extra clear slots may go before the pattern,
+ * between clues, and after it.
+ *
+ * \param[in]  line     The line.
+ * \param[out] pattern  Returns whether each pattern slot is set.
+ * \return the length of the pattern, or SIZE_MAX if it doesn't fit.
+ */
+static size_t puzzle__sat_pattern(
+		const struct puzzle_line *line,
+		bool *pattern)
+{
+	size_t len = 0;
+
+	if (line->clue_count == 0) {
+		return 0;
+	} else if (line->clue_total + line->clue_count - 1 >
+			line->slot_count) {
+		return SIZE_MAX;
+	}
+
+	for (size_t c = 0; c < line->clue_count; c++) {
+		if (c > 0) {
+			pattern[len++] = false;
+		}
+		for (size_t i = 0; i < line->clue[c]; i++) {
+			pattern[len++] = true;
+		}
+	}
+
+	return len;
+}
+
+/**
+ * Get the automaton states a line can be in after a number of slots.
+ *
+ * State `s` means the first `s` slots of the pattern have been matched.
+ * There must be enough slots left to match the rest of the pattern.
+ */
+static inline void puzzle__sat_layer(
+		size_t slot_count,
+		size_t len,
+		size_t t,
+		size_t *lo,
+		size_t *hi)
+{
+	*lo = (len + t > slot_count) ? len + t - slot_count : 0;
+	*hi = (t < len) ? t : len;
+}
+
+static size_t puzzle__sat_line_vars(
+		const struct puzzle_line *line,
+		size_t len)
+{
+	size_t count = 0;
+
+	for (size_t t = 0; t <= line->slot_count; t++) {
+		size_t lo, hi;
+
+		puzzle__sat_layer(line->slot_count, len, t, &lo, &hi);
+		count += hi - lo + 1;
+	}
+
+	return count;
+}
+
+/**
+ * Add the clauses for an automaton transition on a slot value.
+ *
+ * \param[in]  sat    The SAT solver.
+ * \param[in]  from   Literal for the state before the slot.
+ * \param[in]  value  Literal for the slot having the value.
+ * \param[in]  to     Literal for the state after the slot.
+ * \return true on success, false on error.
+ */
+static bool puzzle__sat_step(
+		struct sat *sat,
+		sat_lit from,
+		sat_lit value,
+		sat_lit to)
+{
+	sat_lit lit[3] = { from ^ 1, value ^ 1, to };
+
+	if (!sat_add_clause(sat, lit, 3)) {
+		return false;
+	}
+
+	lit[1] = to ^ 1;
+	lit[2] = value;
+	return sat_add_clause(sat, lit, 3);
+}
+
+/**
+ * Add the clause for a slot value with no automaton transition.
+ */
+static bool puzzle__sat_ban(
+		struct sat *sat,
+		sat_lit from,
+		sat_lit value)
+{
+	sat_lit lit[2] = { from ^ 1, value ^ 1 };
+
+	return sat_add_clause(sat, lit, 2);
+}
+
+/**
+ * Add the clauses for a line to the SAT solver.
+ *
+ * Each line gets an automaton that matches its pattern, with a variable
+ * for each state the automaton can be in after each slot. The automaton
+ * starts in state 0 and must end in the last state. Each state and slot
+ * value implies the next state, each state needs a state that leads to
+ * it, and each pair of consecutive states implies the slot value.
+ *
+ * \param[in]     sat         The SAT solver.
+ * \param[in]     line        The line to encode.
+ * \param[in]     cell_first  Variable for the line's first slot.
+ * \param[in]     cell_step   Distance between slot variables.
+ * \param[in,out] var_next    Next free variable, updated on return.
+ * \param[in]     pattern     Buffer for the line's pattern.
+ * \param[in]     layer       Buffer for each slot's first state variable.
+ * \return true on success, false on error.
+ */
+static bool puzzle__sat_line(
+		struct sat *sat,
+		const struct puzzle_line *line,
+		size_t cell_first,
+		size_t cell_step,
+		size_t *var_next,
+		bool *pattern,
+		size_t *layer)
+{
+	size_t n = line->slot_count;
+	size_t len = puzzle__sat_pattern(line, pattern);
+	sat_lit lit[3];
+
+	if (len == SIZE_MAX) {
+		return sat_add_clause(sat, NULL, 0);
+	}
+
+	for (size_t t = 0; t <= n; t++) {
+		size_t lo, hi;
+
+		puzzle__sat_layer(n, len, t, &lo, &hi);
+		layer[t] = *var_next - lo;
+		*var_next += hi - lo + 1;
+	}
+
+	lit[0] = sat_lit_make(layer[0], true);
+	lit[1] = sat_lit_make(layer[n] + len, true);
+	if (!sat_add_clause(sat, &lit[0], 1) ||
+	    !sat_add_clause(sat, &lit[1], 1)) {
+		return false;
+	}
+
+	for (size_t t = 0; t < n; t++) {
+		sat_lit set = sat_lit_make(cell_first + t * cell_step, true);
+		size_t lo, hi, lo_next, hi_next;
+
+		puzzle__sat_layer(n, len, t, &lo, &hi);
+		puzzle__sat_layer(n, len, t + 1, &lo_next, &hi_next);
+
+		for (size_t s = lo; s <= hi; s++) {
+			bool loop = (s == 0 || s == len || !pattern[s - 1]);
+			sat_lit from = sat_lit_make(layer[t] + s, true);
+			sat_lit to = sat_lit_make(layer[t + 1] + s + 1, true);
+			sat_lit stay = sat_lit_make(layer[t + 1] + s, true);
+			bool ok;
+
+			if (s < len && pattern[s]) {
+				ok = puzzle__sat_step(sat, from, set, to);
+			} else {
+				ok = puzzle__sat_ban(sat, from, set);
+			}
+
+			if (!ok) {
+				return false;
+			} else if (s < len && !pattern[s]) {
+				ok = puzzle__sat_step(sat, from, set ^ 1, to);
+			} else if (loop && s >= lo_next) {
+				ok = puzzle__sat_step(sat, from, set ^ 1, stay);
+			} else {
+				ok = puzzle__sat_ban(sat, from, set ^ 1);
+			}
+
+			if (!ok) {
+				return false;
+			}
+		}
+
+		for (size_t s = lo_next; s <= hi_next; s++) {
+			bool loop = (s == 0 || s == len || !pattern[s - 1]);
+			size_t count = 0;
+
+			/* A state needs a state leading to it. */
+			lit[count++] = sat_lit_make(layer[t + 1] + s, false);
+			if (s > lo && s - 1 <= hi) {
+				lit[count++] = sat_lit_make(
+						layer[t] + s - 1, true);
+			}
+			if (loop && s >= lo && s <= hi) {
+				lit[count++] = sat_lit_make(
+						layer[t] + s, true);
+			}
+			if (!sat_add_clause(sat, lit, count)) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Time since some fixed point, in seconds.
+ */
+static double puzzle__time(void)
+{
+	struct timespec ts;
+
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * Print the line cache statistics, summed over the solver threads.
+ */
+static void puzzle__line_cache_stats(const struct puzzle *p)
+{
+	struct cache_stats total = { 0 };
+
+	for (size_t i = 0; i < p->thread_count; i++) {
+		const struct cache_stats *stats =
+				cache_get_stats(p->scratch[i].cache);
+
+		total.lookups += stats->lookups;
+		total.hits += stats->hits;
+		total.inserts += stats->inserts;
+		total.evictions += stats->evictions;
+		total.entries += stats->entries;
+		total.bytes += stats->bytes;
+	}
+
+	fprintf(stderr, "Line cache: %" PRIu64 " lookups, %" PRIu64 " hits "
+			"(%.1f%%), %" PRIu64 " evictions\n",
+			total.lookups, total.hits, (total.lookups > 0) ?
+			100.0 * (double)total.hits / (double)total.lookups : 0,
+			total.evictions);
+	fprintf(stderr, "Line cache: %" PRIu64 " entries, %" PRIu64 " KiB "
+			"of %" PRIu64 " KiB\n",
+			total.entries, total.bytes / 1024,
+			p->options->line_cache);
+}
+
+/**
+ * Print the line dedupe statistics, summed over the solver threads.
+ */
+static void puzzle__line_dedupe_stats(const struct puzzle *p)
+{
+	uint64_t lines = 0;
+	uint64_t solves = 0;
+
+	for (size_t i = 0; i < p->thread_count; i++) {
+		lines += p->scratch[i].group_lines;
+		solves += p->scratch[i].group_solves;
+	}
+
+	fprintf(stderr, "Line dedupe: %" PRIu64 " lines, %" PRIu64 " solved "
+			"(%.2f lines per solve)\n",
+			lines, solves, (solves > 0) ?
+			(double)lines / (double)solves : 0);
+}
+
+/**
+ * Print the SAT solver's statistics.
+ */
+static void puzzle__sat_stats(const struct sat *sat, double seconds)
+{
+	const struct sat_stats *stats = sat_get_stats(sat);
+	double rate = (seconds > 0) ? 1 / seconds : 0;
+
+	fprintf(stderr, "SAT: %" PRIu64 " variables, %" PRIu64 " clauses\n",
+			stats->variables, stats->clauses);
+	fprintf(stderr, "SAT: %" PRIu64 " decisions (%.0f/s), "
+			"%" PRIu64 " conflicts (%.0f/s), "
+			"%" PRIu64 " propagations (%.0f/s)\n",
+			stats->decisions, (double)stats->decisions * rate,
+			stats->conflicts, (double)stats->conflicts * rate,
+			stats->propagations,
+			(double)stats->propagations * rate);
+	fprintf(stderr, "SAT: %" PRIu64 " restarts, %" PRIu64 " learnt "
+			"clauses, %.3f seconds\n",
+			stats->restarts, stats->learnt, seconds);
+}
+
+/**
+ * Solve the puzzle with the SAT solver.
+ *
+ * The first variables are the cells, in row order, and are true for set
+ * cells. Any solved cells are added as unit clauses. Solutions are counted
+ * by adding a clause that rules out each solution found, and solving
+ * again, until the limit is reached.
+ *
+ * \param[in]  p      The puzzle.
+ * \param[in]  limit  Number of solutions to stop at.
+ * \return the state of the puzzle after solving.
+ */
+static enum puzzle__state puzzle__solve_sat(struct puzzle *p, size_t limit)
+{
+	enum puzzle__state state = PUZZLE__STATE_STALLED;
+	size_t var_count = p->row_count * p->col_count;
+	size_t var_next = var_count;
+	struct sat *sat = NULL;
+	sat_lit *block = NULL;
+	bool *pattern;
+	size_t *layer;
+	double start;
+	bool ok = true;
+
+	pattern = calloc(p->slot_count_max + 1, sizeof(*pattern));
+	layer = calloc(p->slot_count_max + 1, sizeof(*layer));
+	if (pattern == NULL || layer == NULL) {
+		goto error;
+	}
+
+	if (limit > 1) {
+		block = calloc(var_count, sizeof(*block));
+		if (block == NULL) {
+			goto error;
+		}
+	}
+
+	for (size_t r = 0; r < p->row_count; r++) {
+		size_t len = puzzle__sat_pattern(&p->row[r], pattern);
+
+		if (len != SIZE_MAX) {
+			var_count += puzzle__sat_line_vars(&p->row[r], len);
+		}
+	}
+	for (size_t c = 0; c < p->col_count; c++) {
+		size_t len = puzzle__sat_pattern(&p->col[c], pattern);
+
+		if (len != SIZE_MAX) {
+			var_count += puzzle__sat_line_vars(&p->col[c], len);
+		}
+	}
+
+	sat = sat_create(var_count);
+	if (sat == NULL) {
+		goto error;
+	}
+
+	for (size_t r = 0; r < p->row_count; r++) {
+		if (!puzzle__sat_line(sat, &p->row[r], r * p->col_count, 1,
+				&var_next, pattern, layer)) {
+			goto error;
+		}
+	}
+	for (size_t c = 0; c < p->col_count; c++) {
+		if (!puzzle__sat_line(sat, &p->col[c], c, p->col_count,
+				&var_next, pattern, layer)) {
+			goto error;
+		}
+	}
+
+	for (size_t c = 0; c < p->row_count * p->col_count; c++) {
+		enum puzzle_cell cell = puzzle_cell_get(p->cell, c);
+		sat_lit lit;
+
+		if (cell != PUZZLE_CELL_UNKNOWN) {
+			lit = sat_lit_make(c, cell == PUZZLE_CELL_SET);
+			if (!sat_add_clause(sat, &lit, 1)) {
+				goto error;
+			}
+		}
+	}
+
+	start = puzzle__time();
+	while (p->solution_count < limit && sat_solve(sat, &ok)) {
+		size_t cells = p->row_count * p->col_count;
+
+		if (p->solution_count++ == 0) {
+			for (size_t c = 0; c < cells; c++) {
+				p->solution[c] = sat_value(sat, c);
+			}
+		}
+
+		if (p->solution_count < limit) {
+			for (size_t c = 0; c < cells; c++) {
+				block[c] = sat_lit_make(c, !sat_value(sat, c));
+			}
+			if (!sat_add_clause(sat, block, cells)) {
+				ok = false;
+				break;
+			}
+		}
+	}
+	puzzle__sat_stats(sat, puzzle__time() - start);
+	if (!ok) {
+		goto error;
+	}
+
+	if (p->solution_count > 0) {
+		puzzle__solution_apply(p);
+		state = PUZZLE__STATE_SOLVED;
+	} else {
+		state = PUZZLE__STATE_CONTRADICTION;
+	}
+
+	sat_free(sat);
+	free(pattern);
+	free(layer);
+	free(block);
+	return state;
+
+error:
+	fprintf(stderr, "Error: SAT solver failed!\n");
+	sat_free(sat);
+	free(pattern);
+	free(layer);
+	free(block);
+	return state;
+}
+
+/**
+ * Solve the puzzle with the line solvers, and probe and search if enabled.
+ */
+static enum puzzle__state puzzle__solve_lines(
+		struct puzzle *p,
+		size_t limit)
+{
+	enum puzzle__state state = puzzle__propagate(p);
+
+	if (state == PUZZLE__STATE_CONTRADICTION) {
+		fprintf(stderr, "ERROR: Couldn't fit clues on line!\n");
+		return state;
+	}
+
+	if (state == PUZZLE__STATE_STALLED && p->options->probe) {
+		state = puzzle__probe(p);
+	}
+
+	if (state == PUZZLE__STATE_SOLVED) {
+		/* Solved without guessing, so this is the only solution. */
+		p->solution_count = 1;
+	} else if (state == PUZZLE__STATE_STALLED && (p->options->search ||
+			p->options->count_solutions > 0)) {
+		state = puzzle__search(p, limit);
+	}
+	if (state == PUZZLE__STATE_CONTRADICTION) {
+		fprintf(stderr, "ERROR: Puzzle has no solution!\n");
+	}
+
+	return state;
+}
+
+bool puzzle_solve(struct puzzle *p)
+{
+	enum puzzle__state state;
+	size_t limit = 1;
+
+	if (p->options->count_solutions > 0) {
+		/* Telling a unique solution apart needs a second one. */
+		limit = (p->options->count_solutions > 2) ?
+				(size_t)p->options->count_solutions : 2;
+	}
+
+	if (p->queue != NULL) {
+		size_t line_count = p->row_count + p->col_count;
+
+		for (size_t id = 0; id < line_count; id++) {
+			puzzle__queue_push(p, id);
+		}
+	}
+
+	switch (p->options->backend) {
+	case PUZZLE_BACKEND_SAT:
+		state = puzzle__solve_sat(p, limit);
+		if (state == PUZZLE__STATE_CONTRADICTION) {
+			fprintf(stderr, "ERROR: Puzzle has no solution!\n");
+		}
+		break;
+
+	default:
+		state = puzzle__solve_lines(p, limit);
+		break;
+	}
+
+	if (state == PUZZLE__STATE_STALLED) {
+		fprintf(stderr, "Couldn't solve puzzle!\n");
+	}
+
+	if (p->options->line_cache > 0) {
+		puzzle__line_cache_stats(p);
+	}
+	if (p->options->line_dedupe) {
+		puzzle__line_dedupe_stats(p);
+	}
+
+	puzzle__notify(p, OUTPUT_EVENT_FINAL);
+	return state != PUZZLE__STATE_CONTRADICTION;
+}
+
+/** Number of different random lines timed by \ref puzzle_line_time. */
+#define PUZZLE_TIME_LINES 64
+
+/** Shortest time to spend solving lines in \ref puzzle_line_time. */
+#define PUZZLE_TIME_MIN 0.01
+
+/**
+ * Get a pseudo-random number, with xorshift64.
+ */
+static uint64_t puzzle__random(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+	return x;
+}
+
+/**
+ * Set up a random line for \ref puzzle_line_time.
+ *
+ * The clues cover between half and all of the slots they can, and each
+ * slot of a random solution for them is solved with a one in four chance.
+ */
+static void puzzle__time_line_make(
+		struct puzzle_scratch *sc,
+		struct puzzle_line *line,
+		uint64_t *rng)
+{
+	size_t n = line->slot_count;
+	size_t k = line->clue_count;
+	size_t room = n - (k - 1);
+	size_t fill = room / 2 + puzzle__random(rng) % (room - room / 2 + 1);
+	size_t slack = room - fill;
+	size_t pos = 0;
+
+	if (fill < k) {
+		fill = k;
+		slack = room - fill;
+	}
+
+	sc->fixed_count = 0;
+
+	line->clue_total = fill;
+	for (size_t c = 0; c < k; c++) {
+		line->clue[c] = 1;
+	}
+	for (size_t i = k; i < fill; i++) {
+		line->clue[puzzle__random(rng) % k]++;
+	}
+
+	memset(line->cell, 0, n / 4 + 1);
+	line->total = 0;
+	line->slack = slack;
+	if (line->known_set != NULL) {
+		memset(line->known_set, 0, bits_words(n) * sizeof(uint64_t));
+		memset(line->known_clear, 0, bits_words(n) * sizeof(uint64_t));
+	}
+	if (line->clear_next != NULL) {
+		for (size_t s = 0; s < n; s++) {
+			line->clear_next[s] = (uint32_t)n;
+		}
+	}
+	puzzle__line_range_reset(line);
+
+	for (size_t c = 0; c <= k; c++) {
+		size_t gap = (c < k) ? puzzle__random(rng) % (slack + 1) : slack;
+		size_t end = pos + gap + ((c > 0 && c < k) ? 1 : 0);
+
+		slack -= gap;
+		for (; pos < end; pos++) {
+			if (puzzle__random(rng) % 4 == 0) {
+				puzzle__line_slot_done(sc, line, pos, false);
+			}
+		}
+		if (c == k) {
+			break;
+		}
+		for (end = pos + line->clue[c]; pos < end; pos++) {
+			if (puzzle__random(rng) % 4 == 0) {
+				puzzle__line_slot_done(sc, line, pos, true);
+			}
+		}
+	}
+
+	sc->fixed_count = 0;
+}
+
+bool puzzle_line_time(
+		const struct options *opt,
+		enum puzzle_line_solver solver,
+		size_t slot_count,
+		size_t clue_count,
+		double *seconds)
+{
+	struct options options = *opt;
+	struct puzzle p = {
+		.options = &options,
+		.clue_start_count = clue_count,
+		.slot_count_max = slot_count,
+		.thread_count = 1,
+	};
+	struct puzzle_line *lines = NULL;
+	struct puzzle_scratch sc = { 0 };
+	size_t words = bits_words(slot_count);
+	size_t solves = 0;
+	double elapsed = 0;
+	bool ok = false;
+
+	if (clue_count == 0 || 2 * clue_count > slot_count + 1) {
+		return false;
+	}
+
+	options.line_solver = solver;
+	options.line_cache = 0;
+	options.line_dedupe = false;
+	if (!puzzle__scratch_init(&p, &sc)) {
+		goto exit;
+	}
+
+	lines = calloc(PUZZLE_TIME_LINES, sizeof(*lines));
+	if (lines == NULL) {
+		goto exit;
+	}
+
+	for (size_t i = 0; i < PUZZLE_TIME_LINES; i++) {
+		struct puzzle_line *line = &lines[i];
+
+		line->slot_count = slot_count;
+		line->clue_count = clue_count;
+		line->cell_step = 1;
+		line->clue = calloc(clue_count, sizeof(*line->clue));
+		line->start_min = calloc(clue_count, sizeof(*line->start_min));
+		line->start_max = calloc(clue_count, sizeof(*line->start_max));
+		line->cell = calloc(slot_count / 4 + 1, sizeof(*line->cell));
+		if (line->clue == NULL || line->start_min == NULL ||
+		    line->start_max == NULL || line->cell == NULL) {
+			goto exit;
+		}
+
+		if (opt->style == OUTPUT_STYLE_DETAILS) {
+			line->count = calloc(slot_count, sizeof(*line->count));
+			if (line->count == NULL) {
+				goto exit;
+			}
+		}
+
+		if (opt->packed) {
+			line->known_set = calloc(words, sizeof(uint64_t));
+			line->known_clear = calloc(words, sizeof(uint64_t));
+			if (line->known_set == NULL ||
+			    line->known_clear == NULL) {
+				goto exit;
+			}
+		} else if (solver != PUZZLE_LINE_SOLVER_OVERLAP) {
+			line->clear_next = calloc(slot_count,
+					sizeof(*line->clear_next));
+			if (line->clear_next == NULL) {
+				goto exit;
+			}
+		}
+	}
+
+	while (elapsed < PUZZLE_TIME_MIN) {
+		uint64_t rng = 0x9e3779b97f4a7c15 ^ slot_count ^
+				((uint64_t)clue_count << 32);
+		double start;
+
+		for (size_t i = 0; i < PUZZLE_TIME_LINES; i++) {
+			puzzle__time_line_make(&sc, &lines[i], &rng);
+		}
+
+		start = puzzle__time();
+		for (size_t i = 0; i < PUZZLE_TIME_LINES; i++) {
+			sc.fixed_count = 0;
+			puzzle__line_solve_uncached(&p, &sc, &lines[i]);
+		}
+		elapsed += puzzle__time() - start;
+		solves += PUZZLE_TIME_LINES;
+	}
+
+	*seconds = elapsed / (double)solves;
+	ok = true;
+
+exit:
+	if (lines != NULL) {
+		for (size_t i = 0; i < PUZZLE_TIME_LINES; i++) {
+			free(lines[i].clue);
+			free(lines[i].start_min);
+			free(lines[i].start_max);
+			free(lines[i].cell);
+			free(lines[i].count);
+			free(lines[i].known_set);
+			free(lines[i].known_clear);
+			free(lines[i].clear_next);
+		}
+		free(lines);
+	}
+	puzzle__scratch_free(&sc);
 	return ok;
 }
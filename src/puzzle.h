@@ -7,12 +7,53 @@
 #ifndef PUZZLE_H
 #define PUZZLE_H
 
-/** A slot on a puzzle line. */
-struct puzzle_slot {
-	bool done;    /**< Whether this slot is solved. */
-	size_t value; /**< Value of this slot. */
+#include "output.h"
+
+struct arena;
+struct cache;
+struct options;
+struct tune;
+
+/**
+ * Solver event callback.
+ *
+ * \param[in]  pw     Client private data.
+ * \param[in]  event  The event.
+ * \return true on success, or false on error.
+ */
+typedef bool (*puzzle_event_fn)(void *pw, enum output_event event);
+
+enum puzzle_backend {
+	PUZZLE_BACKEND_LINES, // Line solvers, with optional probe and search.
+	PUZZLE_BACKEND_SAT,   // Built-in clause-learning SAT solver.
+};
+
+enum puzzle_line_solver {
+	PUZZLE_LINE_SOLVER_ENUMERATE, // Try every placement of the clues.
+	PUZZLE_LINE_SOLVER_OVERLAP,   // Left-most/right-most packing overlap.
+	PUZZLE_LINE_SOLVER_AUTO,      // Pick a line solver for each line.
+};
+
+enum puzzle_scheduler {
+	PUZZLE_SCHEDULER_PASS,  // Alternate full row and column passes.
+	PUZZLE_SCHEDULER_QUEUE, // Solve lines from a priority work queue.
+};
+
+/**
+ * State of a cell.
+ *
+ * Cell states are packed four to a byte, in row order, and shared by the
+ * cell's row and column.
+ */
+enum puzzle_cell {
+	PUZZLE_CELL_UNKNOWN = 0x0, // Not solved yet.
+	PUZZLE_CELL_CLEAR   = 0x2, // Solved, and not part of a clue.
+	PUZZLE_CELL_SET     = 0x3, // Solved, and part of a clue.
 };
 
+/** Bit set in the state of a solved cell. */
+#define PUZZLE_CELL_DONE 0x2
+
 /** A line of the puzzle (used for both rows and columns). */
 struct puzzle_line {
 	size_t *clue;      /**< Array of loaded clue values for this line. */
@@ -21,36 +62,236 @@ struct puzzle_line {
 
 	size_t total; /**< Solver: Number of "done" slots on line. */
 
-	struct puzzle_slot *slot; /**< Solver: Array of slots on line. */
-	size_t slot_count;        /**< Solver: Number of entries in array. */
-	size_t slot_max;          /**< Solver: Maximum slot value. */
+	uint8_t *cell;     /**< Solver: Packed cell states the line is in. */
+	size_t cell_first; /**< Solver: Index in cell of the first slot. */
+	size_t cell_step;  /**< Solver: Index step between the line's slots. */
+	size_t slot_count; /**< Solver: Number of slots on the line. */
+
+	uint32_t *count; /**< Detail style: Placements covering each slot. */
+	size_t slot_max; /**< Detail style: Total placements of the line. */
+
+	uint64_t *known_set;   /**< Solver: Packed set slots, or NULL. */
+	uint64_t *known_clear; /**< Solver: Packed clear slots, or NULL. */
+
+	uint32_t *clear_next; /**< Enumerator: Next clear slot from each slot. */
+
+	size_t *start_min; /**< Solver: Lowest start slot of each clue. */
+	size_t *start_max; /**< Solver: Highest start slot of each clue. */
 
 	bool update_needed; /**< The line state needs update (a solver run). */
+
+	size_t slack;     /**< Slots not needed by clues and their gaps. */
+	size_t fresh;     /**< Queue scheduler: Slots solved since last run. */
+	size_t queue_pos; /**< Queue scheduler: Work queue index or SIZE_MAX. */
+};
+
+/** Line solver scratch space, one per solver thread. */
+struct puzzle_scratch {
+	size_t *clue_start; /**< Enumerator: Start slot of each placed clue. */
+	size_t *start_min;  /**< Line solvers: Lowest start found per clue. */
+	size_t *start_max;  /**< Line solvers: Highest start found per clue. */
+	size_t *tally;      /**< Enumerator: Placements covering each slot. */
+	size_t tally_max;   /**< Enumerator: Number of placements. */
+	uint64_t *placed;   /**< Packed solver: Slots covered by placed clues. */
+	uint64_t *trim_set;   /**< Packed solver: Trimmed line's set mask. */
+	uint64_t *trim_clear; /**< Packed solver: Trimmed line's clear mask. */
+
+	size_t *pre_set;   /**< Overlap solver: Set slots before each slot. */
+	size_t *pre_clear; /**< Overlap solver: Clear slots before each slot. */
+	size_t *cover;     /**< Overlap solver: Clue coverage per slot. */
+	bool *fwd;         /**< Overlap solver: Prefix placement table. */
+	bool *bwd;         /**< Overlap solver: Suffix placement table. */
+	size_t *fwd_count; /**< Overlap solver: Prefix placement counts. */
+	size_t *bwd_count; /**< Overlap solver: Suffix placement counts. */
+	double *fwd_log;   /**< Overlap solver: Prefix log placement counts. */
+	double *bwd_log;   /**< Overlap solver: Suffix log placement counts. */
+
+	size_t *fixed;      /**< Slots solved by the last line solve. */
+	size_t fixed_count; /**< Number of entries in fixed. */
+
+	struct cache *cache;   /**< Line cache: Solve results, or NULL. */
+	uint64_t *cache_key;   /**< Line cache: Key being looked up. */
+	uint64_t *cache_value; /**< Line cache: Value being added. */
+
+	size_t *group;       /**< Line dedupe: First identical line, per line. */
+	size_t *group_table; /**< Line dedupe: Hash table of line indexes. */
+	size_t group_mask;   /**< Line dedupe: Hash table size, minus one. */
+	uint64_t group_lines;  /**< Line dedupe: Lines wanted by passes. */
+	uint64_t group_solves; /**< Line dedupe: Distinct lines solved. */
+};
+
+/** A search guess, and the trail length to undo to if it fails. */
+struct puzzle_guess {
+	size_t trail_mark; /**< Trail length before the guess. */
+	size_t row;        /**< Row of the guessed cell. */
+	size_t col;        /**< Column of the guessed cell. */
+	bool set;          /**< Whether the cell was guessed set. */
+};
+
+/** A line solve for a worker thread, run on a copy of the line. */
+struct puzzle_job {
+	struct puzzle_line *lines; /**< Array of lines containing the line. */
+	size_t line_idx;           /**< Index of the line to solve. */
+	struct puzzle_line line;   /**< Working copy of the line. */
+
+	uint8_t *cell;         /**< Buffer for working copy's cell states. */
+	uint32_t *count;       /**< Buffer for working copy's counts. */
+	uint64_t *known_set;   /**< Buffer for working copy's set mask. */
+	uint64_t *known_clear; /**< Buffer for working copy's clear mask. */
+	uint32_t *clear_next;  /**< Buffer for working copy's gap index. */
+	size_t *start_min;     /**< Buffer for working copy's lowest starts. */
+	size_t *start_max;     /**< Buffer for working copy's highest starts. */
+
+	size_t *fixed;      /**< Slots solved by the job. */
+	size_t fixed_count; /**< Number of entries in fixed. */
+	bool ok;            /**< Whether the line could be solved. */
+};
+
+/** Cells whose output may have changed since the output last drew them. */
+struct puzzle_changes {
+	uint64_t *seen; /**< Bit for each cell, set if it is in cell. */
+	size_t *cell;   /**< Changed cells, as row order cell indexes. */
+	size_t count;   /**< Number of entries in cell. */
+	bool all;       /**< Whether every cell may have changed. */
 };
 
 /** Puzzle data representation. */
 struct puzzle {
 	char *name;
 
+	struct arena *arena; /**< Memory for the puzzle, its lines and slots. */
+
+	const struct options *options;
+
+	puzzle_event_fn event_fn; /**< Solver event callback, or NULL. */
+	void *event_pw;           /**< Client private data for event_fn. */
+
 	struct puzzle_line *col;
 	struct puzzle_line *row;
 
+	uint8_t *cell; /**< Packed state of every cell, in row order. */
+
+	struct puzzle_changes *changes; /**< Output: Changed cells, or NULL. */
+
+	uint8_t *cell_col;    /**< Column passes: Column order copy of cell. */
+	uint64_t *tile_dirty; /**< Column passes: Tiles changed since copied. */
+	bool col_shadow;      /**< Column passes: Columns are cell_col views. */
+
 	size_t col_count;
 	size_t row_count;
 
 	size_t cells_complete;
+	size_t pass_count; /**< Number of pass events raised. */
 
 	size_t clue_total;
 
-	size_t *clue_start;
-	size_t clue_start_count;
+	size_t clue_start_count; /**< Maximum clue count of any line. */
+	size_t slot_count_max;   /**< Maximum slot count of any line. */
+
+	size_t *queue;      /**< Queue scheduler: Heap of line IDs. */
+	size_t queue_count; /**< Queue scheduler: Number of queued lines. */
+
+	struct tune *tune; /**< Auto line solver: When to use each solver. */
+
+	struct puzzle_scratch *scratch; /**< Scratch space for each thread. */
+	size_t thread_count;            /**< Number of solver threads. */
+
+	struct pool *pool;       /**< Worker threads, or NULL if single. */
+	struct puzzle_job *job;  /**< Line solves for worker threads. */
+	size_t job_count;        /**< Number of entries in job. */
+
+	size_t *trail;       /**< Search: Cells solved, in solve order. */
+	size_t trail_count;  /**< Search: Number of entries in trail. */
+	struct puzzle_guess *guess; /**< Search: Stack of open guesses. */
+	size_t guess_count;         /**< Search: Number of entries in guess. */
+
+	uint8_t *solution;     /**< First solution found, non-zero if set. */
+	size_t solution_count; /**< Number of solutions found. */
+
+	struct puzzle_probe *probe; /**< Probe: Puzzle copy for each thread. */
+	size_t *probe_cell;         /**< Probe: Unsolved cells to probe. */
+	size_t probe_cell_count;    /**< Probe: Number of entries probe_cell. */
+	bool probing;               /**< Probe: This is a probing copy. */
 };
 
+/** A probing thread's copy of the puzzle state. */
+struct puzzle_probe {
+	struct puzzle copy; /**< Copy of the puzzle, sharing its clues. */
+
+	size_t *seen;  /**< Cell values solved by probing set, stamped. */
+	size_t stamp;  /**< Stamp of the current probe. */
+	uint8_t *fix;  /**< Values each cell was found to need. */
+	bool contradiction; /**< Whether a cell could be neither value. */
+};
+
+/**
+ * Get the state of a cell from an array of packed cell states.
+ *
+ * \param[in]  cell  The packed cell states.
+ * \param[in]  idx   Index of the cell.
+ * \return the cell's state.
+ */
+static inline enum puzzle_cell puzzle_cell_get(
+		const uint8_t *cell,
+		size_t idx)
+{
+	return (enum puzzle_cell)((cell[idx / 4] >> (idx % 4 * 2)) & 0x3);
+}
+
+/**
+ * Get the state of a slot on a line.
+ *
+ * \param[in]  line  The line.
+ * \param[in]  pos   Index of the slot on the line.
+ * \return the slot's cell state.
+ */
+static inline enum puzzle_cell puzzle_line_get(
+		const struct puzzle_line *line,
+		size_t pos)
+{
+	return puzzle_cell_get(line->cell,
+			line->cell_first + pos * line->cell_step);
+}
+
 void puzzle_free(struct puzzle *p);
 
-struct puzzle *puzzle_create(const char *path);
+struct puzzle *puzzle_create(
+		const struct options *opt,
+		const char *path);
+
+void puzzle_set_event_fn(
+		struct puzzle *p,
+		puzzle_event_fn fn,
+		void *pw);
 
 bool puzzle_is_complete(const struct puzzle *p);
 bool puzzle_solve(struct puzzle *p);
 
+/**
+ * Forget the changed cells, once the output has drawn them.
+ *
+ * \param[in]  changes  The puzzle's changed cells.
+ */
+void puzzle_changes_clear(struct puzzle_changes *changes);
+
+/**
+ * Time a line solver on random lines.
+ *
+ * Each line has a random solution for its clues, with some of its slots
+ * solved.
+ *
+ * \param[in]  opt         The options to solve the lines with.
+ * \param[in]  solver      The line solver to time.
+ * \param[in]  slot_count  Number of slots on each line.
+ * \param[in]  clue_count  Number of clues on each line.
+ * \param[out] seconds     Returns the mean time to solve a line.
+ * \return true on success, or false on error.
+ */
+bool puzzle_line_time(
+		const struct options *opt,
+		enum puzzle_line_solver solver,
+		size_t slot_count,
+		size_t clue_count,
+		double *seconds);
+
 #endif /* PUZZLE_H */
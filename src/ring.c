@@ -0,0 +1,188 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Single producer, single consumer ring of slots.
+ *
+ * Each end only writes its own counter, so slots are passed without taking
+ * a lock. The lock is only taken by an end that has to sleep, because the
+ * ring is full or empty, and by the other end to wake it.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <threads.h>
+
+#include "ring.h"
+
+struct ring {
+	atomic_size_t head; /**< Number of slots ever pushed. */
+	atomic_size_t tail; /**< Number of slots ever popped. */
+	atomic_bool closed; /**< Whether the producer has finished. */
+
+	/** Whether the producer is waiting for a free slot. */
+	atomic_bool push_asleep;
+	/** Whether the consumer is waiting for a filled slot. */
+	atomic_bool pop_asleep;
+
+	size_t count; /**< Number of slots. */
+
+	mtx_t lock;
+	cnd_t push_wake; /**< Signalled when a slot is freed. */
+	cnd_t pop_wake;  /**< Signalled when a slot is filled. */
+};
+
+/**
+ * Check whether the producer can fill a slot.
+ */
+static bool ring__can_push(const struct ring *ring)
+{
+	return atomic_load(&ring->head) - atomic_load(&ring->tail) <
+			ring->count;
+}
+
+/**
+ * Check whether the consumer can take a slot, or has been told to stop.
+ */
+static bool ring__can_pop(const struct ring *ring)
+{
+	return atomic_load(&ring->tail) != atomic_load(&ring->head) ||
+			atomic_load(&ring->closed);
+}
+
+/**
+ * Wait until an end of the ring can go on.
+ *
+ * The end's flag is set before the check under the lock, and the other end
+ * changes its counter before looking at the flag, so either the check sees
+ * the change, or the other end sees the flag and signals.
+ *
+ * \param[in]  ring    The ring.
+ * \param[in]  ready   Check for whether the end can go on.
+ * \param[in]  asleep  The end's flag for whether it is waiting.
+ * \param[in]  wake    The end's condition to wait on.
+ */
+static void ring__wait(
+		struct ring *ring,
+		bool (*ready)(const struct ring *ring),
+		atomic_bool *asleep,
+		cnd_t *wake)
+{
+	if (ready(ring)) {
+		return;
+	}
+
+	mtx_lock(&ring->lock);
+	atomic_store(asleep, true);
+	while (!ready(ring)) {
+		cnd_wait(wake, &ring->lock);
+	}
+	atomic_store(asleep, false);
+	mtx_unlock(&ring->lock);
+}
+
+/**
+ * Wake an end of the ring, if it is waiting.
+ */
+static void ring__wake(struct ring *ring, atomic_bool *asleep, cnd_t *wake)
+{
+	if (atomic_load(asleep)) {
+		mtx_lock(&ring->lock);
+		cnd_signal(wake);
+		mtx_unlock(&ring->lock);
+	}
+}
+
+struct ring *ring_create(size_t count)
+{
+	struct ring *ring;
+
+	ring = calloc(1, sizeof(*ring));
+	if (ring == NULL) {
+		return NULL;
+	}
+
+	if (mtx_init(&ring->lock, mtx_plain) != thrd_success) {
+		free(ring);
+		return NULL;
+	}
+
+	if (cnd_init(&ring->push_wake) != thrd_success) {
+		mtx_destroy(&ring->lock);
+		free(ring);
+		return NULL;
+	}
+
+	if (cnd_init(&ring->pop_wake) != thrd_success) {
+		cnd_destroy(&ring->push_wake);
+		mtx_destroy(&ring->lock);
+		free(ring);
+		return NULL;
+	}
+
+	ring->count = count;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->closed, false);
+	atomic_init(&ring->push_asleep, false);
+	atomic_init(&ring->pop_asleep, false);
+
+	return ring;
+}
+
+size_t ring_push_slot(struct ring *ring)
+{
+	ring__wait(ring, ring__can_push, &ring->push_asleep, &ring->push_wake);
+
+	return atomic_load(&ring->head) % ring->count;
+}
+
+void ring_push(struct ring *ring)
+{
+	atomic_fetch_add(&ring->head, 1);
+	ring__wake(ring, &ring->pop_asleep, &ring->pop_wake);
+}
+
+bool ring_pop_slot(struct ring *ring, size_t *slot)
+{
+	size_t tail;
+
+	ring__wait(ring, ring__can_pop, &ring->pop_asleep, &ring->pop_wake);
+
+	tail = atomic_load(&ring->tail);
+	if (tail == atomic_load(&ring->head)) {
+		return false;
+	}
+
+	*slot = tail % ring->count;
+	return true;
+}
+
+void ring_pop(struct ring *ring)
+{
+	atomic_fetch_add(&ring->tail, 1);
+	ring__wake(ring, &ring->push_asleep, &ring->push_wake);
+}
+
+void ring_close(struct ring *ring)
+{
+	atomic_store(&ring->closed, true);
+	ring__wake(ring, &ring->pop_asleep, &ring->pop_wake);
+}
+
+void ring_free(struct ring *ring)
+{
+	if (ring != NULL) {
+		cnd_destroy(&ring->pop_wake);
+		cnd_destroy(&ring->push_wake);
+		mtx_destroy(&ring->lock);
+		free(ring);
+	}
+}
@@ -0,0 +1,76 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Single producer, single consumer ring of slots.
+ *
+ * The ring only hands out slot indices; the client owns the slots.
+ */
+
+#ifndef RING_H
+#define RING_H
+
+struct ring;
+
+/**
+ * Create a ring.
+ *
+ * \param[in]  count  Number of slots in the ring.
+ * \return a new ring, or NULL on error.
+ */
+struct ring *ring_create(size_t count);
+
+/**
+ * Get the slot to fill next, waiting until one is free.
+ *
+ * Only called by the producer.
+ *
+ * \param[in]  ring  The ring.
+ * \return the index of the slot to fill.
+ */
+size_t ring_push_slot(struct ring *ring);
+
+/**
+ * Hand the slot from \ref ring_push_slot to the consumer.
+ *
+ * \param[in]  ring  The ring.
+ */
+void ring_push(struct ring *ring);
+
+/**
+ * Get the slot to take next, waiting until one is filled.
+ *
+ * Only called by the consumer.
+ *
+ * \param[in]  ring  The ring.
+ * \param[out] slot  Returns the index of the slot to take.
+ * \return true if there is a slot, or false if the ring is closed and empty.
+ */
+bool ring_pop_slot(struct ring *ring, size_t *slot);
+
+/**
+ * Hand the slot from \ref ring_pop_slot back to the producer.
+ *
+ * \param[in]  ring  The ring.
+ */
+void ring_pop(struct ring *ring);
+
+/**
+ * Close a ring, so the consumer stops once it is empty.
+ *
+ * \param[in]  ring  The ring.
+ */
+void ring_close(struct ring *ring);
+
+/**
+ * Destroy a ring.
+ *
+ * \param[in]  ring  The ring to destroy.
+ */
+void ring_free(struct ring *ring);
+
+#endif /* RING_H */
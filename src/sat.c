@@ -0,0 +1,862 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Conflict-driven clause-learning SAT solver.
+ *
+ * A small solver along the lines of MiniSat: Two watched literals per
+ * clause, first unique implication point clause learning with local
+ * minimisation, variable activity ordering, saved phases, Luby restarts,
+ * and learnt clauses dropped by literal block distance at restarts.
+ *
+ * Clauses are stored one after the other in a single array, as a size,
+ * then a flags word, then the literals. Clauses are referred to by their
+ * offset into the array.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "sat.h"
+
+/** No clause, or no literal. */
+#define SAT__NONE UINT32_MAX
+
+/** Clause flags word: The clause was learnt. */
+#define SAT__LEARNT 0x1
+/** Clause flags word: The clause is to be dropped. */
+#define SAT__DELETED 0x2
+/** Clause flags word: Literal block distance is stored above this. */
+#define SAT__LBD_SHIFT 2
+
+/** Number of conflicts between restarts, scaled by the Luby sequence. */
+#define SAT__RESTART_BASE 100
+/** Variable activity decay factor, applied on each conflict. */
+#define SAT__VAR_DECAY 0.95
+
+/** A clause watching a literal. */
+struct sat__watch {
+	uint32_t cref;   /**< The clause. */
+	sat_lit blocker; /**< A literal of the clause; if true, skip it. */
+};
+
+/** The clauses watching a literal. */
+struct sat__watches {
+	struct sat__watch *w; /**< Array of watches. */
+	size_t count;         /**< Number of entries in w. */
+	size_t cap;           /**< Allocated entries in w. */
+};
+
+struct sat {
+	size_t var_count;
+
+	int8_t *value;     /**< Per variable: 1 true, -1 false, 0 unset. */
+	uint32_t *level;   /**< Per variable: Decision level of assignment. */
+	uint32_t *reason;  /**< Per variable: Implying clause, or NONE. */
+	bool *phase;       /**< Per variable: Last value assigned. */
+	bool *seen;        /**< Per variable: Conflict analysis marks. */
+	double *activity;  /**< Per variable: Decision priority. */
+	double var_inc;    /**< Activity added when a variable is bumped. */
+
+	size_t *heap;      /**< Binary heap of variables, by activity. */
+	size_t *heap_pos;  /**< Per variable: Index in heap, or SIZE_MAX. */
+	size_t heap_count; /**< Number of entries in heap. */
+
+	sat_lit *trail;     /**< Assigned literals, in assignment order. */
+	size_t trail_count; /**< Number of entries in trail. */
+	size_t qhead;       /**< Index in trail of next literal to propagate. */
+	size_t *trail_lim;  /**< Trail length at each decision. */
+	size_t level_count; /**< Current decision level. */
+
+	uint32_t *mem;   /**< Clause storage. */
+	size_t mem_count; /**< Used entries in mem. */
+	size_t mem_cap;   /**< Allocated entries in mem. */
+	size_t clause_count; /**< Number of original clauses. */
+
+	uint32_t *learnt;    /**< Learnt clauses. */
+	size_t learnt_count; /**< Number of entries in learnt. */
+	size_t learnt_max;   /**< Learnt clause count to start dropping at. */
+
+	struct sat__watches *watch; /**< Per literal: Watching clauses. */
+
+	sat_lit *buf;      /**< Clause building buffer. */
+	size_t buf_cap;    /**< Allocated entries in buf. */
+	sat_lit *clear;    /**< Literals to unmark after conflict analysis. */
+	uint32_t *stamp;   /**< Per level: Stamp for counting levels. */
+	uint32_t stamp_next; /**< Next stamp for counting levels. */
+
+	bool unsat; /**< Whether the clauses are known unsatisfiable. */
+	bool oom;   /**< Whether an allocation failed while solving. */
+
+	struct sat_stats stats;
+};
+
+static inline int sat__lit_value(const struct sat *s, sat_lit lit)
+{
+	int v = s->value[lit >> 1];
+
+	return (lit & 1) ? -v : v;
+}
+
+static inline uint32_t *sat__clause(const struct sat *s, uint32_t cref)
+{
+	return &s->mem[cref];
+}
+
+static inline sat_lit *sat__clause_lits(const struct sat *s, uint32_t cref)
+{
+	return &s->mem[cref + 2];
+}
+
+static bool sat__heap_before(const struct sat *s, size_t a, size_t b)
+{
+	return s->activity[a] > s->activity[b];
+}
+
+static void sat__heap_place(struct sat *s, size_t pos, size_t var)
+{
+	s->heap[pos] = var;
+	s->heap_pos[var] = pos;
+}
+
+static void sat__heap_up(struct sat *s, size_t pos)
+{
+	size_t var = s->heap[pos];
+
+	while (pos > 0) {
+		size_t parent = (pos - 1) / 2;
+
+		if (!sat__heap_before(s, var, s->heap[parent])) {
+			break;
+		}
+		sat__heap_place(s, pos, s->heap[parent]);
+		pos = parent;
+	}
+
+	sat__heap_place(s, pos, var);
+}
+
+static void sat__heap_down(struct sat *s, size_t pos)
+{
+	size_t var = s->heap[pos];
+
+	while (true) {
+		size_t child = pos * 2 + 1;
+
+		if (child >= s->heap_count) {
+			break;
+		}
+		if (child + 1 < s->heap_count &&
+		    sat__heap_before(s, s->heap[child + 1], s->heap[child])) {
+			child++;
+		}
+		if (!sat__heap_before(s, s->heap[child], var)) {
+			break;
+		}
+		sat__heap_place(s, pos, s->heap[child]);
+		pos = child;
+	}
+
+	sat__heap_place(s, pos, var);
+}
+
+static void sat__heap_insert(struct sat *s, size_t var)
+{
+	if (s->heap_pos[var] == SIZE_MAX) {
+		sat__heap_place(s, s->heap_count++, var);
+		sat__heap_up(s, s->heap_count - 1);
+	}
+}
+
+static size_t sat__heap_pop(struct sat *s)
+{
+	size_t var = s->heap[0];
+
+	s->heap_pos[var] = SIZE_MAX;
+	s->heap_count--;
+	if (s->heap_count > 0) {
+		sat__heap_place(s, 0, s->heap[s->heap_count]);
+		sat__heap_down(s, 0);
+	}
+
+	return var;
+}
+
+static void sat__var_bump(struct sat *s, size_t var)
+{
+	s->activity[var] += s->var_inc;
+	if (s->activity[var] > 1e100) {
+		for (size_t v = 0; v < s->var_count; v++) {
+			s->activity[v] *= 1e-100;
+		}
+		s->var_inc *= 1e-100;
+	}
+
+	if (s->heap_pos[var] != SIZE_MAX) {
+		sat__heap_up(s, s->heap_pos[var]);
+	}
+}
+
+void sat_free(struct sat *s)
+{
+	if (s != NULL) {
+		if (s->watch != NULL) {
+			for (size_t i = 0; i < s->var_count * 2; i++) {
+				free(s->watch[i].w);
+			}
+			free(s->watch);
+		}
+		free(s->value);
+		free(s->level);
+		free(s->reason);
+		free(s->phase);
+		free(s->seen);
+		free(s->activity);
+		free(s->heap);
+		free(s->heap_pos);
+		free(s->trail);
+		free(s->trail_lim);
+		free(s->mem);
+		free(s->learnt);
+		free(s->buf);
+		free(s->clear);
+		free(s->stamp);
+		free(s);
+	}
+}
+
+struct sat *sat_create(size_t var_count)
+{
+	struct sat *s;
+
+	if (var_count >= SAT__NONE / 2) {
+		fprintf(stderr, "Error: Too many SAT variables!\n");
+		return NULL;
+	}
+
+	s = calloc(1, sizeof(*s));
+	if (s == NULL) {
+		return NULL;
+	}
+
+	s->var_count = var_count;
+	s->var_inc = 1;
+	s->stats.variables = var_count;
+	s->buf_cap = var_count + 1;
+
+	s->value = calloc(var_count, sizeof(*s->value));
+	s->level = calloc(var_count, sizeof(*s->level));
+	s->reason = calloc(var_count, sizeof(*s->reason));
+	s->phase = calloc(var_count, sizeof(*s->phase));
+	s->seen = calloc(var_count, sizeof(*s->seen));
+	s->activity = calloc(var_count, sizeof(*s->activity));
+	s->heap = calloc(var_count, sizeof(*s->heap));
+	s->heap_pos = calloc(var_count, sizeof(*s->heap_pos));
+	s->trail = calloc(var_count, sizeof(*s->trail));
+	s->trail_lim = calloc(var_count + 1, sizeof(*s->trail_lim));
+	s->watch = calloc(var_count * 2, sizeof(*s->watch));
+	s->buf = calloc(s->buf_cap, sizeof(*s->buf));
+	s->clear = calloc(var_count + 1, sizeof(*s->clear));
+	s->stamp = calloc(var_count + 1, sizeof(*s->stamp));
+	if (s->value == NULL || s->level == NULL || s->reason == NULL ||
+	    s->phase == NULL || s->seen == NULL || s->activity == NULL ||
+	    s->heap == NULL || s->heap_pos == NULL || s->trail == NULL ||
+	    s->trail_lim == NULL || s->watch == NULL || s->buf == NULL ||
+	    s->clear == NULL || s->stamp == NULL) {
+		sat_free(s);
+		return NULL;
+	}
+
+	for (size_t v = 0; v < var_count; v++) {
+		s->reason[v] = SAT__NONE;
+		s->heap_pos[v] = SIZE_MAX;
+		sat__heap_insert(s, v);
+	}
+
+	return s;
+}
+
+static void sat__enqueue(struct sat *s, sat_lit lit, uint32_t reason)
+{
+	size_t var = lit >> 1;
+
+	s->value[var] = (lit & 1) ? -1 : 1;
+	s->level[var] = (uint32_t)s->level_count;
+	s->reason[var] = reason;
+	s->trail[s->trail_count++] = lit;
+}
+
+static bool sat__watch_add(
+		struct sat *s,
+		sat_lit lit,
+		uint32_t cref,
+		sat_lit blocker)
+{
+	struct sat__watches *ws = &s->watch[lit];
+
+	if (ws->count == ws->cap) {
+		size_t cap = (ws->cap == 0) ? 4 : ws->cap * 2;
+		struct sat__watch *w = realloc(ws->w, cap * sizeof(*w));
+
+		if (w == NULL) {
+			return false;
+		}
+		ws->w = w;
+		ws->cap = cap;
+	}
+
+	ws->w[ws->count++] = (struct sat__watch) {
+		.cref = cref,
+		.blocker = blocker,
+	};
+	return true;
+}
+
+/**
+ * Store a clause of at least two literals, and watch its first two.
+ *
+ * \return the clause, or NONE on error.
+ */
+static uint32_t sat__clause_add(
+		struct sat *s,
+		const sat_lit *lit,
+		size_t count,
+		uint32_t flags)
+{
+	uint32_t cref = (uint32_t)s->mem_count;
+
+	if (s->mem_count + count + 2 > s->mem_cap) {
+		size_t cap = (s->mem_cap == 0) ? 1024 : s->mem_cap * 2;
+		uint32_t *mem;
+
+		while (s->mem_count + count + 2 > cap) {
+			cap *= 2;
+		}
+		if (cap >= SAT__NONE) {
+			fprintf(stderr, "Error: Too many SAT clauses!\n");
+			return SAT__NONE;
+		}
+
+		mem = realloc(s->mem, cap * sizeof(*mem));
+		if (mem == NULL) {
+			return SAT__NONE;
+		}
+		s->mem = mem;
+		s->mem_cap = cap;
+	}
+
+	s->mem[s->mem_count++] = (uint32_t)count;
+	s->mem[s->mem_count++] = flags;
+	memcpy(&s->mem[s->mem_count], lit, count * sizeof(*lit));
+	s->mem_count += count;
+
+	if (!sat__watch_add(s, lit[0], cref, lit[1]) ||
+	    !sat__watch_add(s, lit[1], cref, lit[0])) {
+		return SAT__NONE;
+	}
+
+	return cref;
+}
+
+static int sat__lit_cmp(const void *a, const void *b)
+{
+	sat_lit la = *(const sat_lit *)a;
+	sat_lit lb = *(const sat_lit *)b;
+
+	return (la > lb) - (la < lb);
+}
+
+/**
+ * Undo assignments down to the given decision level.
+ */
+static void sat__backtrack(struct sat *s, size_t level)
+{
+	if (s->level_count <= level) {
+		return;
+	}
+
+	for (size_t i = s->trail_count; i-- > s->trail_lim[level];) {
+		size_t var = s->trail[i] >> 1;
+
+		s->phase[var] = (s->value[var] > 0);
+		s->value[var] = 0;
+		s->reason[var] = SAT__NONE;
+		sat__heap_insert(s, var);
+	}
+
+	s->trail_count = s->trail_lim[level];
+	s->qhead = s->trail_count;
+	s->level_count = level;
+}
+
+bool sat_add_clause(struct sat *s, const sat_lit *lit, size_t count)
+{
+	size_t j = 0;
+
+	/* Clauses added after solving apply from the top level. */
+	sat__backtrack(s, 0);
+
+	s->stats.clauses++;
+	if (s->unsat) {
+		return true;
+	} else if (count == 0) {
+		s->unsat = true;
+		return true;
+	}
+
+	if (count > s->buf_cap) {
+		sat_lit *buf = realloc(s->buf, count * sizeof(*buf));
+
+		if (buf == NULL) {
+			return false;
+		}
+		s->buf = buf;
+		s->buf_cap = count;
+	}
+
+	memcpy(s->buf, lit, count * sizeof(*lit));
+	qsort(s->buf, count, sizeof(*s->buf), sat__lit_cmp);
+
+	/* Drop duplicate and false literals, and satisfied clauses. */
+	for (size_t i = 0; i < count; i++) {
+		sat_lit l = s->buf[i];
+
+		if (sat__lit_value(s, l) > 0 ||
+		    (j > 0 && s->buf[j - 1] == (l ^ 1))) {
+			return true;
+		}
+		if (sat__lit_value(s, l) == 0 &&
+		    (j == 0 || s->buf[j - 1] != l)) {
+			s->buf[j++] = l;
+		}
+	}
+
+	if (j == 0) {
+		s->unsat = true;
+		return true;
+	} else if (j == 1) {
+		sat__enqueue(s, s->buf[0], SAT__NONE);
+		return true;
+	}
+
+	s->clause_count++;
+	return sat__clause_add(s, s->buf, j, 0) != SAT__NONE;
+}
+
+/**
+ * Propagate the assigned literals through the clauses watching them.
+ *
+ * \return the conflicting clause, or NONE if there was no conflict.
+ */
+static uint32_t sat__propagate(struct sat *s)
+{
+	uint32_t confl = SAT__NONE;
+
+	while (s->qhead < s->trail_count) {
+		sat_lit false_lit = s->trail[s->qhead++] ^ 1;
+		struct sat__watches *ws = &s->watch[false_lit];
+		size_t i = 0;
+		size_t j = 0;
+
+		s->stats.propagations++;
+
+		while (i < ws->count) {
+			struct sat__watch w = ws->w[i++];
+			uint32_t size = sat__clause(s, w.cref)[0];
+			sat_lit *lits = sat__clause_lits(s, w.cref);
+			sat_lit first;
+			bool moved = false;
+
+			if (sat__lit_value(s, w.blocker) > 0) {
+				ws->w[j++] = w;
+				continue;
+			}
+
+			if (lits[0] == false_lit) {
+				lits[0] = lits[1];
+				lits[1] = false_lit;
+			}
+			first = lits[0];
+			w.blocker = first;
+
+			if (sat__lit_value(s, first) > 0) {
+				ws->w[j++] = w;
+				continue;
+			}
+
+			for (uint32_t k = 2; k < size; k++) {
+				if (sat__lit_value(s, lits[k]) >= 0) {
+					lits[1] = lits[k];
+					lits[k] = false_lit;
+					moved = sat__watch_add(s, lits[1],
+							w.cref, first);
+					if (!moved) {
+						lits[k] = lits[1];
+						lits[1] = false_lit;
+						s->oom = true;
+					}
+					break;
+				}
+			}
+			if (moved) {
+				continue;
+			}
+
+			ws->w[j++] = w;
+			if (sat__lit_value(s, first) < 0) {
+				confl = w.cref;
+				s->qhead = s->trail_count;
+				while (i < ws->count) {
+					ws->w[j++] = ws->w[i++];
+				}
+			} else {
+				sat__enqueue(s, first, w.cref);
+			}
+		}
+
+		ws->count = j;
+	}
+
+	return confl;
+}
+
+/**
+ * Check whether a literal of a learnt clause is implied by the others.
+ *
+ * It is, if every other literal of its reason is already in the clause.
+ */
+static bool sat__lit_redundant(const struct sat *s, sat_lit lit)
+{
+	uint32_t reason = s->reason[lit >> 1];
+	const sat_lit *lits;
+	uint32_t size;
+
+	if (reason == SAT__NONE) {
+		return false;
+	}
+
+	size = sat__clause(s, reason)[0];
+	lits = sat__clause_lits(s, reason);
+	for (uint32_t k = 1; k < size; k++) {
+		size_t var = lits[k] >> 1;
+
+		if (!s->seen[var] && s->level[var] > 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Learn a clause from a conflict, at the first unique implication point.
+ *
+ * The learnt clause is left in buf, with the literal to assert first and
+ * a literal from the level to backtrack to second.
+ *
+ * \param[in]  s      The solver.
+ * \param[in]  confl  The conflicting clause.
+ * \param[out] level  Returns the level to backtrack to.
+ * \param[out] lbd    Returns the literal block distance of the clause.
+ * \return the number of literals in the learnt clause.
+ */
+static size_t sat__analyze(
+		struct sat *s,
+		uint32_t confl,
+		size_t *level,
+		uint32_t *lbd)
+{
+	size_t index = s->trail_count;
+	sat_lit lit = SAT__NONE;
+	size_t path = 0;
+	size_t count = 1;
+	size_t kept = 1;
+
+	do {
+		uint32_t size = sat__clause(s, confl)[0];
+		const sat_lit *lits = sat__clause_lits(s, confl);
+
+		for (uint32_t k = (lit == SAT__NONE) ? 0 : 1; k < size; k++) {
+			size_t var = lits[k] >> 1;
+
+			if (s->seen[var] || s->level[var] == 0) {
+				continue;
+			}
+
+			s->seen[var] = true;
+			sat__var_bump(s, var);
+			if (s->level[var] >= s->level_count) {
+				path++;
+			} else {
+				s->buf[count++] = lits[k];
+			}
+		}
+
+		while (!s->seen[s->trail[--index] >> 1]) {
+		}
+		lit = s->trail[index];
+		confl = s->reason[lit >> 1];
+		s->seen[lit >> 1] = false;
+		path--;
+	} while (path > 0);
+
+	s->buf[0] = lit ^ 1;
+
+	memcpy(s->clear, s->buf, count * sizeof(*s->buf));
+	for (size_t i = 1; i < count; i++) {
+		if (!sat__lit_redundant(s, s->buf[i])) {
+			s->buf[kept++] = s->buf[i];
+		}
+	}
+	for (size_t i = 1; i < count; i++) {
+		s->seen[s->clear[i] >> 1] = false;
+	}
+
+	*level = 0;
+	for (size_t i = 1; i < kept; i++) {
+		if (s->level[s->buf[i] >> 1] > *level) {
+			sat_lit swap = s->buf[1];
+
+			s->buf[1] = s->buf[i];
+			s->buf[i] = swap;
+			*level = s->level[s->buf[1] >> 1];
+		}
+	}
+
+	*lbd = 0;
+	s->stamp_next++;
+	for (size_t i = 0; i < kept; i++) {
+		uint32_t l = s->level[s->buf[i] >> 1];
+
+		if (s->stamp[l] != s->stamp_next) {
+			s->stamp[l] = s->stamp_next;
+			(*lbd)++;
+		}
+	}
+
+	return kept;
+}
+
+static bool sat__learn(struct sat *s, size_t count, uint32_t lbd)
+{
+	uint32_t cref;
+
+	if (count == 1) {
+		sat__enqueue(s, s->buf[0], SAT__NONE);
+		return true;
+	}
+
+	if (s->learnt_count % 1024 == 0) {
+		uint32_t *learnt = realloc(s->learnt,
+				(s->learnt_count + 1024) * sizeof(*learnt));
+
+		if (learnt == NULL) {
+			return false;
+		}
+		s->learnt = learnt;
+	}
+
+	cref = sat__clause_add(s, s->buf, count,
+			SAT__LEARNT | lbd << SAT__LBD_SHIFT);
+	if (cref == SAT__NONE) {
+		return false;
+	}
+
+	s->learnt[s->learnt_count++] = cref;
+	s->stats.learnt++;
+	sat__enqueue(s, s->buf[0], cref);
+	return true;
+}
+
+static int sat__u64_cmp(const void *a, const void *b)
+{
+	uint64_t ua = *(const uint64_t *)a;
+	uint64_t ub = *(const uint64_t *)b;
+
+	return (ua > ub) - (ua < ub);
+}
+
+/**
+ * Drop the half of the learnt clauses with the highest literal block
+ * distance, keeping those that join at most two decision levels.
+ *
+ * Must be called at decision level zero. The clause storage is compacted
+ * and the watches are rebuilt.
+ */
+static bool sat__reduce(struct sat *s)
+{
+	uint64_t *order = malloc(s->learnt_count * sizeof(*order));
+	size_t mem_count = s->mem_count;
+
+	if (order == NULL) {
+		return false;
+	}
+
+	for (size_t i = 0; i < s->learnt_count; i++) {
+		uint32_t lbd = sat__clause(s, s->learnt[i])[1] >>
+				SAT__LBD_SHIFT;
+
+		order[i] = (uint64_t)lbd << 32 | s->learnt[i];
+	}
+	qsort(order, s->learnt_count, sizeof(*order), sat__u64_cmp);
+	for (size_t i = s->learnt_count / 2; i < s->learnt_count; i++) {
+		if (order[i] >> 32 > 2) {
+			sat__clause(s, (uint32_t)order[i])[1] |= SAT__DELETED;
+		}
+	}
+	free(order);
+
+	for (size_t v = 0; v < s->var_count; v++) {
+		s->reason[v] = SAT__NONE;
+	}
+	for (size_t l = 0; l < s->var_count * 2; l++) {
+		s->watch[l].count = 0;
+	}
+
+	s->mem_count = 0;
+	s->learnt_count = 0;
+	for (size_t cref = 0; cref < mem_count;) {
+		uint32_t size = s->mem[cref];
+		uint32_t flags = s->mem[cref + 1];
+		uint32_t moved;
+
+		if (flags & SAT__DELETED) {
+			cref += size + 2;
+			continue;
+		}
+
+		/* Clauses only move down, so this can't allocate. */
+		moved = (uint32_t)s->mem_count;
+		memmove(&s->mem[s->mem_count], &s->mem[cref],
+				(size + 2) * sizeof(*s->mem));
+		s->mem_count += size + 2;
+		cref += size + 2;
+
+		if (!sat__watch_add(s, s->mem[moved + 2], moved,
+				s->mem[moved + 3]) ||
+		    !sat__watch_add(s, s->mem[moved + 3], moved,
+				s->mem[moved + 2])) {
+			return false;
+		}
+		if (flags & SAT__LEARNT) {
+			s->learnt[s->learnt_count++] = moved;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Get a term of the Luby sequence: 1, 1, 2, 1, 1, 2, 4, 1, 1, 2, ...
+ */
+static uint64_t sat__luby(uint64_t x)
+{
+	uint64_t size = 1;
+	unsigned seq = 0;
+
+	while (size < x + 1) {
+		seq++;
+		size = 2 * size + 1;
+	}
+
+	while (size - 1 != x) {
+		size = (size - 1) >> 1;
+		seq--;
+		x = x % size;
+	}
+
+	return (uint64_t)1 << seq;
+}
+
+bool sat_solve(struct sat *s, bool *ok)
+{
+	uint64_t conflicts_left = SAT__RESTART_BASE * sat__luby(0);
+
+	*ok = true;
+	s->learnt_max = s->clause_count / 3 + 10000;
+
+	while (!s->unsat) {
+		uint32_t confl = sat__propagate(s);
+
+		if (s->oom) {
+			*ok = false;
+			return false;
+		}
+
+		if (confl != SAT__NONE) {
+			size_t level;
+			size_t count;
+			uint32_t lbd;
+
+			s->stats.conflicts++;
+			if (s->level_count == 0) {
+				s->unsat = true;
+				break;
+			}
+
+			count = sat__analyze(s, confl, &level, &lbd);
+			sat__backtrack(s, level);
+			if (!sat__learn(s, count, lbd)) {
+				*ok = false;
+				return false;
+			}
+
+			s->var_inc /= SAT__VAR_DECAY;
+			if (conflicts_left > 0) {
+				conflicts_left--;
+			}
+
+		} else if (conflicts_left == 0) {
+			sat__backtrack(s, 0);
+			s->stats.restarts++;
+			conflicts_left = SAT__RESTART_BASE *
+					sat__luby(s->stats.restarts);
+
+			if (s->learnt_count >= s->learnt_max) {
+				if (!sat__reduce(s)) {
+					*ok = false;
+					return false;
+				}
+				s->learnt_max += s->learnt_max / 10;
+			}
+
+		} else {
+			size_t var = SIZE_MAX;
+
+			while (s->heap_count > 0) {
+				var = sat__heap_pop(s);
+				if (s->value[var] == 0) {
+					break;
+				}
+				var = SIZE_MAX;
+			}
+			if (var == SIZE_MAX) {
+				return true;
+			}
+
+			s->stats.decisions++;
+			s->trail_lim[s->level_count++] = s->trail_count;
+			sat__enqueue(s, sat_lit_make(var, s->phase[var]),
+					SAT__NONE);
+		}
+	}
+
+	return false;
+}
+
+bool sat_value(const struct sat *s, size_t var)
+{
+	return s->value[var] > 0;
+}
+
+const struct sat_stats *sat_get_stats(const struct sat *s)
+{
+	return &s->stats;
+}
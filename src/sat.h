@@ -0,0 +1,100 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Conflict-driven clause-learning SAT solver.
+ */
+
+#ifndef SAT_H
+#define SAT_H
+
+struct sat;
+
+/**
+ * A literal: A variable index, times two, plus one if negated.
+ */
+typedef uint32_t sat_lit;
+
+/** SAT solver statistics. */
+struct sat_stats {
+	uint64_t variables;    /**< Number of variables. */
+	uint64_t clauses;      /**< Number of clauses added. */
+	uint64_t decisions;    /**< Number of variables chosen. */
+	uint64_t conflicts;    /**< Number of conflicts analysed. */
+	uint64_t propagations; /**< Number of literals propagated. */
+	uint64_t restarts;     /**< Number of restarts. */
+	uint64_t learnt;       /**< Number of clauses learnt. */
+};
+
+/**
+ * Get the literal for a variable.
+ *
+ * \param[in]  var       Index of the variable.
+ * \param[in]  positive  Whether the literal is true when the variable is.
+ * \return the literal.
+ */
+static inline sat_lit sat_lit_make(size_t var, bool positive)
+{
+	return (sat_lit)(var * 2 + (positive ? 0 : 1));
+}
+
+/**
+ * Create a SAT solver.
+ *
+ * \param[in]  var_count  Number of variables.
+ * \return a new solver, or NULL on error.
+ */
+struct sat *sat_create(size_t var_count);
+
+/**
+ * Add a clause to a SAT solver.
+ *
+ * Clauses may be added between calls to \ref sat_solve, once the model
+ * has been read, to look for a different model. A clause with no literals
+ * makes the clauses unsatisfiable.
+ *
+ * \param[in]  sat    The solver to add the clause to.
+ * \param[in]  lit    Array of literals, at least one of which must hold.
+ * \param[in]  count  Number of entries in lit.
+ * \return true on success, or false on error.
+ */
+bool sat_add_clause(struct sat *sat, const sat_lit *lit, size_t count);
+
+/**
+ * Solve the clauses added to a SAT solver.
+ *
+ * \param[in]  sat  The solver.
+ * \param[out] ok   Returns false on error.
+ * \return true if the clauses can all be satisfied, false otherwise.
+ */
+bool sat_solve(struct sat *sat, bool *ok);
+
+/**
+ * Get the value of a variable in the model found by \ref sat_solve.
+ *
+ * \param[in]  sat  The solver.
+ * \param[in]  var  Index of the variable.
+ * \return the value of the variable.
+ */
+bool sat_value(const struct sat *sat, size_t var);
+
+/**
+ * Get the statistics of a SAT solver.
+ *
+ * \param[in]  sat  The solver.
+ * \return the solver's statistics.
+ */
+const struct sat_stats *sat_get_stats(const struct sat *sat);
+
+/**
+ * Destroy a SAT solver.
+ *
+ * \param[in]  sat  The solver to destroy.
+ */
+void sat_free(struct sat *sat);
+
+#endif /* SAT_H */
@@ -0,0 +1,161 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Line solver tuning.
+ *
+ * The tuning file is text. Lines starting with '#' are comments, and each
+ * other line is `enumerate-slots CLUES SLOTS`, giving the longest line with
+ * CLUES clues that the automatic line solver uses the enumerator for.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "tune.h"
+#include "puzzle.h"
+#include "options.h"
+
+/** Longest line the enumerator is timed on. */
+#define TUNE__SLOTS_MAX 1024
+
+/** Number of line lengths in a row the enumerator must lose on, to stop. */
+#define TUNE__LOSSES 2
+
+/** Longest line tuning file line. */
+#define TUNE__LINE_MAX 128
+
+/** Built-in tuning, from timing the line solvers on a typical machine. */
+static const struct tune tune__default = {
+	.enumerate_slots = { 96, 32, 20, 14, 12, 12, 12, 12 },
+};
+
+void tune_default(struct tune *t)
+{
+	*t = tune__default;
+}
+
+bool tune_load(struct tune *t, const char *path)
+{
+	char line[TUNE__LINE_MAX];
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Error: Failed to open tuning: '%s'\n", path);
+		return false;
+	}
+
+	tune_default(t);
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		size_t clues;
+		size_t slots;
+
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+
+		if (sscanf(line, "enumerate-slots %zu %zu",
+				&clues, &slots) != 2 ||
+		    clues < 1 || clues > TUNE_CLUES) {
+			fprintf(stderr, "Error: Bad tuning line in '%s': %s",
+					path, line);
+			fclose(f);
+			return false;
+		}
+
+		t->enumerate_slots[clues - 1] = slots;
+	}
+
+	fclose(f);
+	return true;
+}
+
+/**
+ * Find the longest line the enumerator is faster than the overlap solver on.
+ *
+ * Line lengths are tried from a little over the shortest that fits the
+ * clues, growing until the enumerator is slower for a few lengths in a
+ * row, so one noisy timing doesn't end the search.
+ *
+ * \param[in]  options  The options to time the line solvers with.
+ * \param[in]  clues    Number of clues on each line.
+ * \param[out] slots    Returns the longest line to use the enumerator for.
+ * \return true on success, or false on error.
+ */
+static bool tune__enumerate_slots(
+		const struct options *options,
+		size_t clues,
+		size_t *slots)
+{
+	size_t losses = 0;
+
+	*slots = 0;
+
+	for (size_t n = 2 * clues + 2; n <= TUNE__SLOTS_MAX &&
+			losses < TUNE__LOSSES; n += n / 4) {
+		double enumerate;
+		double overlap;
+
+		if (!puzzle_line_time(options, PUZZLE_LINE_SOLVER_ENUMERATE,
+				n, clues, &enumerate) ||
+		    !puzzle_line_time(options, PUZZLE_LINE_SOLVER_OVERLAP,
+				n, clues, &overlap)) {
+			return false;
+		}
+
+		if (enumerate > overlap) {
+			losses++;
+		} else {
+			losses = 0;
+			*slots = n;
+		}
+	}
+
+	return true;
+}
+
+int tune_run(const struct options *options)
+{
+	struct tune t;
+	FILE *f;
+
+	for (size_t c = 0; c < TUNE_CLUES; c++) {
+		if (!tune__enumerate_slots(options, c + 1,
+				&t.enumerate_slots[c])) {
+			fprintf(stderr, "Error: Failed to time line solvers!\n");
+			return EXIT_FAILURE;
+		}
+		printf("%zu clue%s: Enumerate lines up to %zu slots.\n",
+				c + 1, (c > 0) ? "s" : "",
+				t.enumerate_slots[c]);
+	}
+
+	f = fopen(options->tune, "w");
+	if (f == NULL) {
+		fprintf(stderr, "Error: Failed to open tuning: '%s'\n",
+				options->tune);
+		return EXIT_FAILURE;
+	}
+
+	fprintf(f, "# NonoGIF line solver tuning, written by --tune.\n");
+	for (size_t c = 0; c < TUNE_CLUES; c++) {
+		fprintf(f, "enumerate-slots %zu %zu\n",
+				c + 1, t.enumerate_slots[c]);
+	}
+
+	if (fclose(f) != 0) {
+		fprintf(stderr, "Error: Failed to write tuning: '%s'\n",
+				options->tune);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
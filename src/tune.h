@@ -0,0 +1,57 @@
+/*
+ * SPDX-License-Identifier: ISC
+ *
+ * Copyright (C) 2022 Michael Drake <tlsa@netsurf-browser.org>
+ */
+
+/**
+ * \file
+ * \brief Line solver tuning.
+ */
+
+#ifndef TUNE_H
+#define TUNE_H
+
+struct options;
+
+/** Most clues on a line that the enumerator is ever used for. */
+#define TUNE_CLUES 8
+
+/** When the automatic line solver picks each line solver. */
+struct tune {
+	/**
+	 * Longest line to solve with the enumerator, for each clue count
+	 * from one clue. Longer lines are solved with the overlap solver.
+	 */
+	size_t enumerate_slots[TUNE_CLUES];
+};
+
+/**
+ * Set the built-in tuning.
+ *
+ * \param[out] t  The tuning to set.
+ */
+void tune_default(struct tune *t);
+
+/**
+ * Load tuning from a tuning file.
+ *
+ * Anything not given in the file is left at the built-in tuning.
+ *
+ * \param[out] t     The tuning to set.
+ * \param[in]  path  Path to the tuning file.
+ * \return true on success, or false on error.
+ */
+bool tune_load(struct tune *t, const char *path);
+
+/**
+ * Time the line solvers on this machine, and write a tuning file.
+ *
+ * The tuning file is written to the options' tune path.
+ *
+ * \param[in]  options  The options to time the line solvers with.
+ * \return the exit status.
+ */
+int tune_run(const struct options *options);
+
+#endif /* TUNE_H */